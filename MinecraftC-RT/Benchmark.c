@@ -0,0 +1,220 @@
+#include <SDL2/SDL.h>
+#include "Benchmark.h"
+#include "Minecraft.h"
+#include "Level/Generator/LevelGenerator.h"
+#include "Render/OctreeRenderer.h"
+#include "Utilities/Log.h"
+#include "Utilities/Memory.h"
+#include "Utilities/String.h"
+
+#define BenchmarkSeed 20090517
+#define BenchmarkLevelSize 256
+#define BenchmarkWarmupFrames 8
+#define BenchmarkFrameRate 60.0
+#define BenchmarkPathFrames 240
+
+typedef struct CameraSample
+{
+	float3 Position;
+	float2 Rotation;
+} CameraSample;
+
+static const int2 BenchmarkResolutions[] = { { 640, 360 }, { 1280, 720 }, { 1920, 1080 } };
+static const char * BenchmarkPipelines[] = { "megakernel", "wavefront", "persistent" };
+static const char * BenchmarkStorages[] = { "dense", "brickmap", "morton" };
+
+static const CameraSample BenchmarkKeyframes[] =
+{
+	{ { 32.0, 52.0, 32.0 }, { 15.0, 315.0 } },
+	{ { 128.0, 56.0, 64.0 }, { 25.0, 270.0 } },
+	{ { 208.0, 48.0, 128.0 }, { 5.0, 200.0 } },
+	{ { 160.0, 40.0, 208.0 }, { -10.0, 135.0 } },
+	{ { 64.0, 60.0, 192.0 }, { 45.0, 45.0 } },
+	{ { 32.0, 52.0, 32.0 }, { 15.0, -45.0 } },
+};
+
+static SDL_RWops * Recording = NULL;
+
+void BenchmarkToggleRecording(const char * directory)
+{
+	if (Recording != NULL)
+	{
+		SDL_RWclose(Recording);
+		Recording = NULL;
+		LogInfo("Stopped recording camera path\n");
+		return;
+	}
+	char path[1024];
+	snprintf(path, sizeof(path), "%sCameraPath.txt", directory);
+	Recording = SDL_RWFromFile(path, "w");
+	if (Recording == NULL) { LogWarning("Failed to record camera path %s: %s\n", path, SDL_GetError()); }
+	else { LogInfo("Recording camera path to %s\n", path); }
+}
+
+void BenchmarkRecordCamera(Player player)
+{
+	if (Recording == NULL) { return; }
+	char line[128];
+	int length = snprintf(line, sizeof(line), "%.3f %.3f %.3f %.3f %.3f\n", player->Position.x, player->Position.y, player->Position.z, player->Rotation.x, player->Rotation.y);
+	SDL_RWwrite(Recording, line, length, 1);
+}
+
+static list(CameraSample) LoadCameraPath(const char * path)
+{
+	list(CameraSample) samples = ListCreate(sizeof(CameraSample));
+	SDL_RWops * file = SDL_RWFromFile(path, "r");
+	if (file == NULL) { LogFatal("Failed to open camera path %s: %s\n", path, SDL_GetError()); }
+	size_t fileSize = (size_t)SDL_RWseek(file, 0, RW_SEEK_END);
+	SDL_RWseek(file, 0, RW_SEEK_SET);
+	char * text = MemoryAllocate(fileSize + 1);
+	SDL_RWread(file, text, fileSize, 1);
+	SDL_RWclose(file);
+	text[fileSize] = '\0';
+
+	CameraSample sample;
+	int read = 0;
+	for (char * cursor = text; sscanf(cursor, "%f %f %f %f %f%n", &sample.Position.x, &sample.Position.y, &sample.Position.z, &sample.Rotation.x, &sample.Rotation.y, &read) == 5; cursor += read)
+	{
+		samples = ListPush(samples, &sample);
+	}
+	MemoryFree(text);
+	if (ListCount(samples) == 0) { LogFatal("Camera path %s has no samples\n", path); }
+	return samples;
+}
+
+static list(CameraSample) DefaultCameraPath()
+{
+	list(CameraSample) samples = ListCreate(sizeof(CameraSample));
+	int segments = sizeof(BenchmarkKeyframes) / sizeof(BenchmarkKeyframes[0]) - 1;
+	for (int i = 0; i < BenchmarkPathFrames; i++)
+	{
+		float t = (float)i / BenchmarkPathFrames * segments;
+		int k = (int)t;
+		float f = t - k;
+		CameraSample a = BenchmarkKeyframes[k], b = BenchmarkKeyframes[k + 1];
+		CameraSample sample = { a.Position + (b.Position - a.Position) * f, a.Rotation + (b.Rotation - a.Rotation) * f };
+		samples = ListPush(samples, &sample);
+	}
+	return samples;
+}
+
+static int CompareTimes(const void * a, const void * b)
+{
+	float x = *(const float *)a, y = *(const float *)b;
+	return (x > y) - (x < y);
+}
+
+static float Percentile(list(float) times, float p)
+{
+	int index = (int)ceil(p * ListCount(times)) - 1;
+	return times[index < 0 ? 0 : index];
+}
+
+int BenchmarkRun(int argc, char * argv[])
+{
+	const char * pathFile = NULL, * outputFile = NULL;
+	RenderPipeline pipeline = RenderPipelineMegakernel;
+	BlockStorage storage = BlockStorageDense;
+	bool temporal = true, caches = true;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--path") == 0 && i + 1 < argc) { pathFile = argv[++i]; }
+		else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) { outputFile = argv[++i]; }
+		else if (strcmp(argv[i], "--no-temporal") == 0) { temporal = false; }
+		else if (strcmp(argv[i], "--no-caches") == 0) { caches = false; }
+		else if (strcmp(argv[i], "--pipeline") == 0 && i + 1 < argc)
+		{
+			i++;
+			pipeline = RenderPipelineCount;
+			for (int j = 0; j < RenderPipelineCPU; j++) { if (strcmp(argv[i], BenchmarkPipelines[j]) == 0) { pipeline = j; } }
+			if (pipeline == RenderPipelineCount) { LogFatal("Unsupported benchmark pipeline %s (expected megakernel, wavefront or persistent)\n", argv[i]); }
+		}
+		else if (strcmp(argv[i], "--storage") == 0 && i + 1 < argc)
+		{
+			i++;
+			storage = BlockStorageCount;
+			for (int j = 0; j < BlockStorageCount; j++) { if (strcmp(argv[i], BenchmarkStorages[j]) == 0) { storage = j; } }
+			if (storage == BlockStorageCount) { LogFatal("Unsupported benchmark storage %s (expected dense, brickmap or morton)\n", argv[i]); }
+		}
+	}
+
+	list(CameraSample) path = pathFile != NULL ? LoadCameraPath(pathFile) : DefaultCameraPath();
+	BlocksInitialize();
+	struct Minecraft host = { .Running = true, .Width = BenchmarkResolutions[0].x, .Height = BenchmarkResolutions[0].y };
+	ProgressBarDisplay progress = ProgressBarDisplayCreate(&host);
+	LevelGenerator generator = LevelGeneratorCreate(progress, BenchmarkSeed);
+	Level level = LevelGeneratorGenerate(generator, "benchmark", BenchmarkLevelSize, BenchmarkLevelSize, 64);
+	LevelGeneratorDestroy(generator);
+	level->Player = PlayerCreate(level);
+	Player player = level->Player;
+
+	char * cacheDirectory = SDL_GetPrefPath("NotMojang", "MinecraftC");
+	OctreeRendererInitialize(NULL, BenchmarkResolutions[0].x, BenchmarkResolutions[0].y, storage, cacheDirectory);
+	OctreeRendererSetTraversalMode(TraversalModeOctree);
+	OctreeRendererSetPipeline(pipeline);
+	OctreeRendererSetAsyncFrames(false);
+	OctreeRendererSetOctree(level->Octree);
+	OctreeRenderer.CollectStatistics = true;
+	OctreeRenderer.TemporalReprojection = temporal;
+	OctreeRendererSetShadingCaches(caches);
+
+	char name[256] = { 0 }, device[512] = { 0 };
+	clGetDeviceInfo(OctreeRenderer.Device, CL_DEVICE_NAME, sizeof(name) - 1, name, NULL);
+	for (int i = 0, j = 0; name[i] != '\0'; i++)
+	{
+		if (name[i] == '"' || name[i] == '\\') { device[j++] = '\\'; }
+		device[j++] = (unsigned char)name[i] < ' ' ? ' ' : name[i];
+	}
+	char line[1024];
+	snprintf(line, sizeof(line), "{\n\t\"seed\": %i,\n\t\"level\": [%i, %i, %i],\n\t\"device\": \"%s\",\n\t\"pipeline\": \"%s\",\n\t\"storage\": \"%s\",\n\t\"temporal\": %s,\n\t\"caches\": %s,\n\t\"frames\": %i,\n\t\"results\":\n\t[\n", BenchmarkSeed, level->Width, level->Depth, level->Height, device, BenchmarkPipelines[OctreeRenderer.Pipeline], BenchmarkStorages[OctreeRenderer.Storage], temporal ? "true" : "false", caches ? "true" : "false", ListCount(path));
+	String json = StringCreate(line);
+
+	list(float) times = ListCreate(sizeof(float));
+	int resolutionCount = sizeof(BenchmarkResolutions) / sizeof(BenchmarkResolutions[0]);
+	for (int i = 0; i < resolutionCount; i++)
+	{
+		int2 resolution = BenchmarkResolutions[i];
+		OctreeRendererResize(resolution.x, resolution.y);
+		times = ListClear(times);
+		double rays = 0.0, seconds = 0.0, steps = 0.0;
+		for (int j = -BenchmarkWarmupFrames; j < ListCount(path); j++)
+		{
+			int frame = j < 0 ? 0 : j;
+			player->Position = path[frame].Position;
+			player->OldPosition = path[frame].Position;
+			player->Rotation = path[frame].Rotation;
+			player->OldRotation = path[frame].Rotation;
+			OctreeRendererEnqueue(1.0, frame / BenchmarkFrameRate, false);
+			if (j < 0) { continue; }
+			float trace = OctreeRenderer.Profiles[(OctreeRenderer.ProfileCount - 1) % ProfileWindow].Stages[ProfileStageTrace];
+			if (trace <= 0.0f) { trace = OctreeRenderer.KernelTime; }
+			times = ListPush(times, &trace);
+			rays += OctreeRenderer.RayCount;
+			steps += OctreeRenderer.StepsPerRay;
+			seconds += trace / 1000.0;
+		}
+		qsort(times, ListCount(times), sizeof(float), CompareTimes);
+		snprintf(line, sizeof(line), "\t\t{ \"width\": %i, \"height\": %i, \"min\": %.3f, \"median\": %.3f, \"p99\": %.3f, \"max\": %.3f, \"raysPerSecond\": %.0f, \"stepsPerRay\": %.2f }%s\n", resolution.x, resolution.y, times[0], Percentile(times, 0.5), Percentile(times, 0.99), times[ListCount(times) - 1], seconds > 0.0 ? rays / seconds : 0.0, steps / ListCount(times), i < resolutionCount - 1 ? "," : "");
+		json = StringConcat(json, line);
+		LogInfo("%ix%i: %.3f ms median, %.3f ms p99\n", resolution.x, resolution.y, Percentile(times, 0.5), Percentile(times, 0.99));
+	}
+	json = StringConcat(json, "\t]\n}\n");
+
+	if (outputFile == NULL) { fputs(json, stdout); }
+	else
+	{
+		SDL_RWops * file = SDL_RWFromFile(outputFile, "w");
+		if (file == NULL) { LogFatal("Failed to write %s: %s\n", outputFile, SDL_GetError()); }
+		SDL_RWwrite(file, json, StringLength(json), 1);
+		SDL_RWclose(file);
+	}
+
+	StringDestroy(json);
+	ListDestroy(times);
+	ListDestroy(path);
+	OctreeRendererDeinitialize();
+	LevelDestroy(level);
+	ProgressBarDisplayDestroy(progress);
+	SDL_free(cacheDirectory);
+	return 0;
+}
@@ -0,0 +1,6 @@
+#pragma once
+#include "Player/Player.h"
+
+int BenchmarkRun(int argc, char * argv[]);
+void BenchmarkToggleRecording(const char * directory);
+void BenchmarkRecordCamera(Player player);
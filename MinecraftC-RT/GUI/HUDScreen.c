@@ -74,7 +74,11 @@ void HUDScreenRender(HUDScreen hud, float var1, bool var2, int2 mousePos)
 	}
 		
 	FontRendererRender(hud->Minecraft->Font, "0.30", 2, 2, ColorWhite);
-	if (hud->Minecraft->Settings->ShowFrameRate) { FontRendererRender(hud->Minecraft->Font, hud->Minecraft->Debug, 2, 12, ColorWhite); }
+	if (hud->Minecraft->Settings->ShowFrameRate)
+	{
+		FontRendererRender(hud->Minecraft->Font, hud->Minecraft->Debug, 2, 12, ColorWhite);
+		FontRendererRender(hud->Minecraft->Font, hud->Minecraft->Profile, 2, 22, ColorWhite);
+	}
 		
 	int maxLines = 10;
 	bool chatScreen = false;
@@ -20,13 +20,24 @@ void OptionsScreenOnOpen(OptionsScreen screen)
 	OptionsScreenData this = screen->TypeData;
 	for (int i = 0; i < ListCount(screen->Buttons); i++) { ButtonDestroy(screen->Buttons[i]); }
 	screen->Buttons = ListClear(screen->Buttons);
+	int rows = (this->Settings->SettingsCount + 1) / 2;
+	bool compact = rows > 5;
+	int top = screen->Height / 6 - (compact ? 8 : 0), spacing = compact ? 22 : 24;
 	for (int i = 0; i < this->Settings->SettingsCount; i++)
 	{
-		screen->Buttons = ListPush(screen->Buttons, &(Button){ ButtonCreateSize(i, screen->Width / 2 - 155 + i % 2 * 160, screen->Height / 6 + 24 * (i / 2 + 1) - 24, 150, 20, GameSettingsGetSetting(this->Settings, i)) });
+		screen->Buttons = ListPush(screen->Buttons, &(Button){ ButtonCreateSize(i, screen->Width / 2 - 155 + i % 2 * 160, top + spacing * (i / 2), 150, 20, GameSettingsGetSetting(this->Settings, i)) });
 	}
 	
-	screen->Buttons = ListPush(screen->Buttons, &(Button){ ButtonCreate(100, screen->Width / 2 - 100, screen->Height / 6 + 132, "Controls...") });
-	screen->Buttons = ListPush(screen->Buttons, &(Button){ ButtonCreate(200, screen->Width / 2 - 100, screen->Height / 6 + 168, "Done") });
+	if (compact)
+	{
+		screen->Buttons = ListPush(screen->Buttons, &(Button){ ButtonCreateSize(100, screen->Width / 2 - 155, top + spacing * rows + 8, 150, 20, "Controls...") });
+		screen->Buttons = ListPush(screen->Buttons, &(Button){ ButtonCreateSize(200, screen->Width / 2 + 5, top + spacing * rows + 8, 150, 20, "Done") });
+	}
+	else
+	{
+		screen->Buttons = ListPush(screen->Buttons, &(Button){ ButtonCreate(100, screen->Width / 2 - 100, screen->Height / 6 + 132, "Controls...") });
+		screen->Buttons = ListPush(screen->Buttons, &(Button){ ButtonCreate(200, screen->Width / 2 - 100, screen->Height / 6 + 168, "Done") });
+	}
 }
 
 void OptionsScreenOnButtonClicked(OptionsScreen screen, Button button)
@@ -1,8 +1,15 @@
 #include "GameSettings.h"
 #include "Minecraft.h"
 #include "KeyBinding.h"
+#include "Render/OctreeRenderer.h"
 #include "Utilities/Log.h"
 
+static int StringToIndex(String value, int count, int fallback)
+{
+	int index = StringToInt(value);
+	return index >= 0 && index < count ? index : fallback;
+}
+
 static void Load(GameSettings settings)
 {
 	SDL_RWops * file = SDL_RWFromFile(settings->File, "r");
@@ -33,6 +40,13 @@ static void Load(GameSettings settings)
 			if (strcmp(line, "bobView") == 0) { settings->ViewBobbing = strcmp(value, "true") == 0; }
 			if (strcmp(line, "anaglyph3d") == 0) { settings->Anaglyph = strcmp(value, "true") == 0; }
 			if (strcmp(line, "limitFramerate") == 0) { settings->LimitFramerate = strcmp(value, "true") == 0; }
+			if (strcmp(line, "traversalMode") == 0) { settings->TraversalMode = StringToIndex(value, TraversalModeCount, settings->TraversalMode); }
+			if (strcmp(line, "blockStorage") == 0) { settings->BlockStorage = StringToIndex(value, BlockStorageCount, settings->BlockStorage); }
+			if (strcmp(line, "renderPipeline") == 0) { settings->RenderPipeline = StringToIndex(value, RenderPipelineCount, settings->RenderPipeline); }
+			if (strcmp(line, "dynamicResolution") == 0) { settings->DynamicResolution = strcmp(value, "true") == 0; }
+			if (strcmp(line, "checkerboard") == 0) { settings->Checkerboard = strcmp(value, "true") == 0; }
+			if (strcmp(line, "asyncFrames") == 0) { settings->AsyncFrames = strcmp(value, "true") == 0; }
+			if (strcmp(line, "heatmap") == 0) { settings->Heatmap = StringToIndex(value, RayHeatmapCount, settings->Heatmap); }
 			for (int i = 0; i < ListCount(settings->Bindings); i++)
 			{
 				String keyName = StringConcatFront("key_", StringCreate(settings->Bindings[i]->Name));
@@ -75,6 +89,20 @@ static void Save(GameSettings settings)
 	SDL_RWwrite(file, line, StringLength(line), 1);
 	line = StringConcatFront("limitFramerate:", StringSet(line, settings->LimitFramerate ? "true\n" : "false\n"));
 	SDL_RWwrite(file, line, StringLength(line), 1);
+	line = StringConcat(StringConcatFront("traversalMode:", StringSetFromInt(line, settings->TraversalMode)), "\n");
+	SDL_RWwrite(file, line, StringLength(line), 1);
+	line = StringConcat(StringConcatFront("blockStorage:", StringSetFromInt(line, settings->BlockStorage)), "\n");
+	SDL_RWwrite(file, line, StringLength(line), 1);
+	line = StringConcat(StringConcatFront("renderPipeline:", StringSetFromInt(line, settings->RenderPipeline)), "\n");
+	SDL_RWwrite(file, line, StringLength(line), 1);
+	line = StringConcatFront("dynamicResolution:", StringSet(line, settings->DynamicResolution ? "true\n" : "false\n"));
+	SDL_RWwrite(file, line, StringLength(line), 1);
+	line = StringConcatFront("checkerboard:", StringSet(line, settings->Checkerboard ? "true\n" : "false\n"));
+	SDL_RWwrite(file, line, StringLength(line), 1);
+	line = StringConcatFront("asyncFrames:", StringSet(line, settings->AsyncFrames ? "true\n" : "false\n"));
+	SDL_RWwrite(file, line, StringLength(line), 1);
+	line = StringConcat(StringConcatFront("heatmap:", StringSetFromInt(line, settings->Heatmap)), "\n");
+	SDL_RWwrite(file, line, StringLength(line), 1);
 	for (int i = 0; i < ListCount(settings->Bindings); i++)
 	{
 		String keyName = StringConcat(StringConcatFront("key_", StringCreate(settings->Bindings[i]->Name)), ":");
@@ -99,6 +127,13 @@ GameSettings GameSettingsCreate(Minecraft minecraft)
 		.ViewBobbing = true,
 		.Anaglyph = false,
 		.LimitFramerate = false,
+		.TraversalMode = TraversalModeOctree,
+		.BlockStorage = BlockStorageDense,
+		.RenderPipeline = RenderPipelineMegakernel,
+		.DynamicResolution = false,
+		.Checkerboard = false,
+		.AsyncFrames = true,
+		.Heatmap = RayHeatmapOff,
 		.ForwardKey = (KeyBinding){ .Name = "Forward", .Key = SDL_SCANCODE_W },
 		.LeftKey = (KeyBinding){ .Name = "Left", .Key = SDL_SCANCODE_A },
 		.BackKey = (KeyBinding){ .Name = "Back", .Key = SDL_SCANCODE_S },
@@ -110,7 +145,7 @@ GameSettings GameSettingsCreate(Minecraft minecraft)
 		.SaveLocationKey = (KeyBinding){ .Name = "Save location", .Key = SDL_SCANCODE_RETURN },
 		.LoadLocationKey = (KeyBinding){ .Name = "Load location", .Key = SDL_SCANCODE_R },
 		.Bindings = ListCreate(sizeof(KeyBinding *)),
-		.SettingsCount = 8,
+		.SettingsCount = 15,
 		.Minecraft = minecraft,
 		.File = StringConcat(StringCreate(minecraft->WorkingDirectory), "Options.txt"),
 	};
@@ -149,10 +184,49 @@ void GameSettingsToggleSetting(GameSettings settings, int setting, int var2)
 		settings->LimitFramerate = !settings->LimitFramerate;
 		SDL_GL_SetSwapInterval(settings->LimitFramerate ? 1 : 0);
 	}
+	if (setting == 8)
+	{
+		settings->TraversalMode = (settings->TraversalMode + 1) % TraversalModeCount;
+		OctreeRendererSetTraversalMode(settings->TraversalMode);
+	}
+	if (setting == 9)
+	{
+		settings->BlockStorage = (settings->BlockStorage + 1) % BlockStorageCount;
+		OctreeRendererSetBlockStorage(settings->BlockStorage);
+	}
+	if (setting == 10)
+	{
+		settings->RenderPipeline = (settings->RenderPipeline + 1) % RenderPipelineCount;
+		OctreeRendererSetPipeline(settings->RenderPipeline);
+	}
+	if (setting == 11)
+	{
+		settings->DynamicResolution = !settings->DynamicResolution;
+		OctreeRendererSetDynamicResolution(settings->DynamicResolution);
+	}
+	if (setting == 12)
+	{
+		settings->Checkerboard = !settings->Checkerboard;
+		OctreeRendererSetCheckerboard(settings->Checkerboard);
+	}
+	if (setting == 13)
+	{
+		settings->AsyncFrames = !settings->AsyncFrames;
+		OctreeRendererSetAsyncFrames(settings->AsyncFrames);
+	}
+	if (setting == 14)
+	{
+		settings->Heatmap = (settings->Heatmap + 1) % RayHeatmapCount;
+		OctreeRendererSetHeatmap(settings->Heatmap);
+	}
 	Save(settings);
 }
 
 static char * RenderDistances[] = { "FAR", "NORMAL", "SHORT", "TINY" };
+static char * TraversalModes[] = { "GRID", "OCTREE", "DISTANCE" };
+static char * BlockStorages[] = { "DENSE", "BRICKMAP", "MORTON" };
+static char * RenderPipelines[] = { "MEGAKERNEL", "WAVEFRONT", "PERSISTENT", "CPU" };
+static char * Heatmaps[] = { "OFF", "STEPS", "LAYERS", "SHADOW", "REFLECT" };
 
 String GameSettingsGetSetting(GameSettings settings, int setting)
 {
@@ -166,6 +240,13 @@ String GameSettingsGetSetting(GameSettings settings, int setting)
 		case 5: return StringConcat(StringCreate("View bobbing: "), settings->ViewBobbing ? "ON" : "OFF");
 		case 6: return StringConcat(StringCreate("3d anaglyph: "), settings->Anaglyph ? "ON" : "OFF");
 		case 7: return StringConcat(StringCreate("Limit framerate: "), settings->LimitFramerate ? "ON" : "OFF");
+		case 8: return StringConcat(StringCreate("Traversal: "), TraversalModes[settings->TraversalMode]);
+		case 9: return StringConcat(StringCreate("Block storage: "), BlockStorages[settings->BlockStorage]);
+		case 10: return StringConcat(StringCreate("Pipeline: "), RenderPipelines[settings->RenderPipeline]);
+		case 11: return StringConcat(StringCreate("Dynamic resolution: "), settings->DynamicResolution ? "ON" : "OFF");
+		case 12: return StringConcat(StringCreate("Checkerboard: "), settings->Checkerboard ? "ON" : "OFF");
+		case 13: return StringConcat(StringCreate("Async frames: "), settings->AsyncFrames ? "ON" : "OFF");
+		case 14: return StringConcat(StringConcat(StringCreate("Heatmap: "), Heatmaps[settings->Heatmap]), settings->Heatmap == RayHeatmapOff || OctreeRendererHeatmapSupported() ? "" : " (N/A)");
 		default: return StringCreate("Error");
 	}
 }
@@ -16,6 +16,13 @@ typedef struct GameSettings
 	bool ViewBobbing;
 	bool Anaglyph;
 	bool LimitFramerate;
+	int TraversalMode;
+	int BlockStorage;
+	int RenderPipeline;
+	bool DynamicResolution;
+	bool Checkerboard;
+	bool AsyncFrames;
+	int Heatmap;
 	KeyBinding ForwardKey;
 	KeyBinding LeftKey;
 	KeyBinding BackKey;
@@ -2,16 +2,15 @@
 #include "Noise/Noise.h"
 #include "Noise/OctaveNoise.h"
 #include "Noise/CombinedNoise.h"
-#include "../../Utilities/Time.h"
 #include "../../Utilities/Log.h"
 
-LevelGenerator LevelGeneratorCreate(ProgressBarDisplay progressBar)
+LevelGenerator LevelGeneratorCreate(ProgressBarDisplay progressBar, unsigned long seed)
 {
 	LevelGenerator generator = MemoryAllocate(sizeof(struct LevelGenerator));
 	*generator = (struct LevelGenerator)
 	{
 		.ProgressBar = progressBar,
-		.Random = RandomGeneratorCreate(TimeNano()),
+		.Random = RandomGeneratorCreate(seed),
 		.FloodData = MemoryAllocate(1024 * 1024 * sizeof(int)),
 	};
 	return generator;
@@ -13,6 +13,6 @@ typedef struct LevelGenerator
 	int * FloodData;
 } * LevelGenerator;
 
-LevelGenerator LevelGeneratorCreate(ProgressBarDisplay progressBar);
+LevelGenerator LevelGeneratorCreate(ProgressBarDisplay progressBar, unsigned long seed);
 Level LevelGeneratorGenerate(LevelGenerator generator, const char * userName, int width, int depth, int var);
 void LevelGeneratorDestroy(LevelGenerator generator);
@@ -195,15 +195,7 @@ bool LevelNetSetTileNoNeighborChange(Level level, int x, int y, int z, BlockType
 		LevelRendererQueueChunks(level->Renderers[j], (int3){ x, y, z } - 1, (int3){ x, y, z } + 1);
 	}
 	OctreeSet(level->Octree, x, y, z, tile, true);
-	if (OctreeRenderer.BlockBuffer != NULL)
-	{
-		int error;
-		unsigned char * mem = clEnqueueMapBuffer(OctreeRenderer.Queue, OctreeRenderer.BlockBuffer, true, CL_MAP_WRITE, (y * level->Height + z) * level->Width + x, 1, 0, NULL, NULL, &error);
-		if (error < 0) { LogFatal("Failed to write buffer: %i\n", error); }
-		*mem = tile;
-		error = clEnqueueUnmapMemObject(OctreeRenderer.Queue, OctreeRenderer.BlockBuffer, mem, 0, NULL, NULL);
-		if (error < 0) { LogFatal("Failed to write buffer: %i\n", error); }
-	}
+	OctreeRendererUpdateTile(x, y, z, tile);
 	return true;
 }
 
@@ -230,6 +222,7 @@ bool LevelSetTileNoUpdate(Level level, int x, int y, int z, BlockType tile)
 	int i = (y * level->Height + z) * level->Width + x;
 	if (tile == level->Blocks[i]) { return false; }
 	level->Blocks[i] = tile;
+	OctreeRendererUpdateTile(x, y, z, tile);
 	return true;
 }
 
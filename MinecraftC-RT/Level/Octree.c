@@ -16,15 +16,10 @@ Octree OctreeCreate(Level level)
 	return tree;
 }
 
-static void UpdateBuffer(int index, unsigned char value)
+static void UpdateBuffer(Octree tree, int index)
 {
-	if (OctreeRenderer.OctreeBuffer == NULL) { return; }
-	int error;
-	unsigned char * mem = clEnqueueMapBuffer(OctreeRenderer.Queue, OctreeRenderer.OctreeBuffer, true, CL_MAP_WRITE, index, 1, 0, NULL, NULL, &error);
-	if (error < 0) { LogFatal("Failed to write buffer: %i\n", error); }
-	*mem = value;
-	error = clEnqueueUnmapMemObject(OctreeRenderer.Queue, OctreeRenderer.OctreeBuffer, mem, 0, NULL, NULL);
-	if (error < 0) { LogFatal("Failed to write buffer: %i\n", error); }
+	if (OctreeRenderer.OctreeBuffer == NULL || OctreeRenderer.Octree != tree) { return; }
+	OctreeRendererMarkDirty(DirtyBufferOctree, index, 1);
 }
 
 void OctreeSet(Octree tree, int x, int y, int z, BlockType tile, bool updateBuffer)
@@ -43,7 +38,7 @@ void OctreeSet(Octree tree, int x, int y, int z, BlockType tile, bool updateBuff
 		if (((mask >> q) & 1) == 0)
 		{
 			tree->Masks[start + offset] ^= (1 << q);
-			if (updateBuffer) { UpdateBuffer(start + offset, tree->Masks[start + offset]); }
+			if (updateBuffer) { UpdateBuffer(tree, start + offset); }
 		}
 		
 		qStack[i] = q;
@@ -58,7 +53,7 @@ void OctreeSet(Octree tree, int x, int y, int z, BlockType tile, bool updateBuff
 			for (int j = i; j >= 0; j--)
 			{
 				tree->Masks[indexStack[j]] ^= (1 << qStack[j]);
-				if (updateBuffer) { UpdateBuffer(indexStack[j], tree->Masks[indexStack[j]]); }
+				if (updateBuffer) { UpdateBuffer(tree, indexStack[j]); }
 				if (tree->Masks[indexStack[j]] > 0) { break; }
 			}
 		}
@@ -73,6 +73,7 @@ void BlocksInitialize()
 	BlockSetData(BookshelfBlockCreate(), TileSounds.Wood, 1.0, 1.0, 1.5);
 	BlockSetData(BlockCreate(BlockTypeMossyCobbleStone, 36), TileSounds.Stone, 1.0, 1.0, 1.0);
 	BlockSetData(BlockCreate(BlockTypeObsidian, 37), TileSounds.Stone, 1.0, 1.0, 10.0);
+	for (int i = 0; i < 256; i++) { Blocks.Materials[i] = BlockGetMaterial(i); }
 }
 
 void BlocksDeinitialize()
@@ -495,6 +496,22 @@ int BlockGetRenderPass(Block block)
 	return 0;
 }
 
+BlockMaterial BlockGetMaterial(BlockType type)
+{
+	BlockMaterial material = { .Faces = { BlockTextureMissing, BlockTextureMissing, BlockTextureMissing, BlockTextureMissing, BlockTextureMissing, BlockTextureMissing } };
+	Block block = Blocks.Table[type];
+	if (block == NULL) { return material; }
+	for (int i = 0; i < 6; i++) { material.Faces[i] = BlockGetTextureID(block, i); }
+	bool water = IsLiquidBlock(type) && BlockGetLiquidType(block) == LiquidTypeWater;
+	if (water) { material.Shape = BlockShapeLiquid; }
+	else if (IsFlowerBlock(type)) { material.Shape = BlockShapeCross; }
+	else if (IsSlabBlock(type) && !BlockIsCube(block)) { material.Shape = BlockShapeSlab; }
+	if (type == BlockTypeGlass) { material.Alpha = BlockAlphaMerged; }
+	else if (type == BlockTypeLeaves || IsFlowerBlock(type)) { material.Alpha = BlockAlphaCutout; }
+	if (water || type == BlockTypeGlass) { material.Reflectiveness = 0.25; }
+	return material;
+}
+
 void BlockDestroy(Block block)
 {
 	if (IsLiquidBlock(block->Type)) { LiquidBlockDestroy(block); }
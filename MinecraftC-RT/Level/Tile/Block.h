@@ -67,6 +67,31 @@ typedef enum LiquidType
 	LiquidTypeLava,
 } LiquidType;
 
+typedef enum BlockShape
+{
+	BlockShapeCube,
+	BlockShapeSlab,
+	BlockShapeCross,
+	BlockShapeLiquid,
+} BlockShape;
+
+typedef enum BlockAlpha
+{
+	BlockAlphaBlend,
+	BlockAlphaCutout,
+	BlockAlphaMerged,
+} BlockAlpha;
+
+#define BlockTextureMissing 255
+
+typedef struct BlockMaterial
+{
+	unsigned char Faces[6];
+	unsigned char Shape;
+	unsigned char Alpha;
+	float Reflectiveness;
+} BlockMaterial;
+
 typedef struct Block
 {
 	int TextureID;
@@ -117,6 +142,7 @@ MovingObjectPosition BlockClip(Block block, int x, int y, int z, float3 var1, fl
 void BlockExplode(Block block, struct Level * level, int x, int y, int z);
 bool BlockRender(Block block, struct Level * level, int x, int y, int z);
 int BlockGetRenderPass(Block block);
+BlockMaterial BlockGetMaterial(BlockType type);
 void BlockDestroy(Block block);
 
 extern struct Blocks
@@ -127,6 +153,7 @@ extern struct Blocks
 	bool Cube[256];
 	bool Liquid[256];
 	int TickDelay[256];
+	BlockMaterial Materials[256];
 } Blocks;
 
 void BlocksInitialize(void);
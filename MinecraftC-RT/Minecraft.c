@@ -1,5 +1,6 @@
 #include <OpenGL.h>
 #include "Minecraft.h"
+#include "Benchmark.h"
 #include "GUI/PauseScreen.h"
 #include "GUI/ChatInputScreen.h"
 #include "GUI/BlockSelectScreen.h"
@@ -34,6 +35,7 @@ Minecraft MinecraftCreate(int width, int height, bool fullScreen)
 	minecraft->Height = height;
 	minecraft->FullScreen = fullScreen;
 	minecraft->Debug = StringCreate("");
+	minecraft->Profile = StringCreate("");
 	return minecraft;
 }
 
@@ -173,6 +175,7 @@ static void Tick(Minecraft minecraft, list(SDL_Event) events)
 		AnimatedTextureAnimate(texture);
 		memcpy(minecraft->TextureManager->TextureBuffer, texture->Data, 1024);
 		glTexSubImage2D(GL_TEXTURE_2D, 0, texture->TextureID % 16 << 4, texture->TextureID / 16 << 4, 16, 16, GL_RGBA, GL_UNSIGNED_BYTE, minecraft->TextureManager->TextureBuffer);
+		OctreeRenderer.TerrainDirty = true;
 	}
 	
 	PlayerData player = minecraft->Player->TypeData;
@@ -227,6 +230,10 @@ static void Tick(Minecraft minecraft, list(SDL_Event) events)
 						EntityResetPosition(minecraft->Player);
 					}
 					if (events[i].key.keysym.scancode == SDL_SCANCODE_F5) { minecraft->Raining = !minecraft->Raining; }
+					if (events[i].key.keysym.scancode == SDL_SCANCODE_F6) { OctreeRendererTuneGroupSize(); }
+					if (events[i].key.keysym.scancode == SDL_SCANCODE_F7) { BenchmarkToggleRecording(minecraft->WorkingDirectory); }
+					if (events[i].key.keysym.scancode == SDL_SCANCODE_F8) { OctreeRendererToggleProfileLog(minecraft->WorkingDirectory); }
+					if (events[i].key.keysym.scancode == SDL_SCANCODE_F9) { OctreeRendererSetShadingCaches(!OctreeRenderer.ShadingCaches); }
 					if (events[i].key.keysym.scancode == minecraft->Settings->BuildKey.Key) { MinecraftSetCurrentScreen(minecraft, BlockSelectScreenCreate()); }
 					if (events[i].key.keysym.scancode == minecraft->Settings->ChatKey.Key)
 					{
@@ -311,6 +318,7 @@ static void Tick(Minecraft minecraft, list(SDL_Event) events)
 		LevelTickEntities(minecraft->Level);
 		LevelTick(minecraft->Level);
 		ParticleManagerTick(minecraft->ParticleManager);
+		BenchmarkRecordCamera(minecraft->Player);
 	}
 }
 
@@ -356,7 +364,13 @@ void MinecraftRun(Minecraft minecraft)
 	TextureManagerRegisterAnimation(minecraft->TextureManager, WaterTextureCreate());
 	minecraft->Font = FontRendererCreate(minecraft->Settings, "Default.png", minecraft->TextureManager);
 	minecraft->LevelRenderer = LevelRendererCreate(minecraft, minecraft->TextureManager);
-	OctreeRendererInitialize(minecraft->TextureManager, minecraft->FrameWidth, minecraft->FrameHeight);
+	OctreeRendererInitialize(minecraft->TextureManager, minecraft->FrameWidth, minecraft->FrameHeight, minecraft->Settings->BlockStorage, minecraft->WorkingDirectory);
+	OctreeRendererSetTraversalMode(minecraft->Settings->TraversalMode);
+	OctreeRendererSetPipeline(minecraft->Settings->RenderPipeline);
+	OctreeRendererSetDynamicResolution(minecraft->Settings->DynamicResolution);
+	OctreeRendererSetCheckerboard(minecraft->Settings->Checkerboard);
+	OctreeRendererSetAsyncFrames(minecraft->Settings->AsyncFrames);
+	OctreeRendererSetHeatmap(minecraft->Settings->Heatmap);
 	glViewport(0, 0, minecraft->FrameWidth, minecraft->FrameHeight);
 	
 	if (!minecraft->LevelLoaded)
@@ -406,6 +420,7 @@ void MinecraftRun(Minecraft minecraft)
 	while (minecraft->Running)
 	{
 		if (minecraft->Timer->ElapsedTicks > 0) { events = ListClear(events); };
+		OctreeRenderer.InputTime = TimeNano();
 		SDL_Event event;
 		while (SDL_PollEvent(&event))
 		{
@@ -459,12 +474,14 @@ void MinecraftRun(Minecraft minecraft)
 		timer->ElapsedDelta -= timer->ElapsedTicks;
 		timer->Delta = timer->ElapsedDelta;
 		
+		uint64_t tickStart = TimeNano();
 		for (int i = 0; i < timer->ElapsedTicks; i++)
 		{
 			minecraft->Ticks++;
 			Tick(minecraft, events);
 			events = ListClear(events);
 		}
+		OctreeRenderer.TickTime = (TimeNano() - tickStart) / 1000000.0;
 		
 		CheckGLError(minecraft, "Pre render");
 		glEnable(GL_TEXTURE_2D);
@@ -883,6 +900,7 @@ void MinecraftRun(Minecraft minecraft)
 					
 					if (!minecraft->Settings->Anaglyph) { break; }
 				}
+				OctreeRenderer.CollectStatistics = minecraft->Settings->ShowFrameRate;
 				OctreeRendererEnqueue(delta, timer->LastHR, minecraft->Settings->ViewBobbing);
 				glMatrixMode(GL_PROJECTION);
 				glLoadIdentity();
@@ -921,14 +939,38 @@ void MinecraftRun(Minecraft minecraft)
 			if (minecraft->CurrentScreen != NULL) { GUIScreenRender(minecraft->CurrentScreen, (int2){ mx, my }); }
 			
 			SDL_GL_SwapWindow(minecraft->Window);
+			OctreeRendererFramePresented();
 			
 			CheckGLError(minecraft, "Post render");
 			frame++;
 			
 			while (TimeMilli() >= start + 1000)
 			{
-				String chunks = StringConcat(StringCreateFromInt(minecraft->Player->Position.x), " chunk updates");
+				String chunks = StringConcat(StringCreateFromInt(ChunkUpdates), " chunk updates");
 				minecraft->Debug = StringConcat(StringConcat(StringSetFromInt(minecraft->Debug, frame), " fps, "), chunks);
+				char steps[128];
+				snprintf(steps, sizeof(steps), ", %.1f steps/ray, %.2f ms trace, %i%% scale, %.1f ms frame, %.1f ms latency", OctreeRenderer.StepsPerRay, OctreeRenderer.KernelTime, (int)(OctreeRenderer.RenderScale * 100.0), OctreeRenderer.FrameTime, OctreeRenderer.Latency);
+				minecraft->Debug = StringConcat(minecraft->Debug, steps);
+				if (OctreeRenderer.Pipeline == RenderPipelineWavefront)
+				{
+					float * t = OctreeRenderer.StageTimes;
+					char stages[128];
+					snprintf(stages, sizeof(stages), " (gen %.2f, ext %.2f, shade %.2f, shadow %.2f, refl %.2f, resolve %.2f)", t[0], t[1], t[2], t[3], t[4], t[5]);
+					minecraft->Debug = StringConcat(minecraft->Debug, stages);
+				}
+				if (OctreeRenderer.Heatmap != RayHeatmapOff && !OctreeRendererHeatmapSupported()) { minecraft->Debug = StringConcat(minecraft->Debug, ", no heatmap on this pipeline"); }
+				else if (OctreeRenderer.Heatmap != RayHeatmapOff)
+				{
+					cl_uint * s = OctreeRenderer.Statistics;
+					char totals[128];
+					snprintf(totals, sizeof(totals), ", %u layers, %u shadow steps, %u reflection steps", s[RayStatisticLayers], s[RayStatisticShadowSteps], s[RayStatisticReflectionSteps]);
+					minecraft->Debug = StringConcat(minecraft->Debug, totals);
+				}
+				FrameProfile profile = OctreeRendererAverageProfile();
+				float * p = profile.Stages;
+				char line[256];
+				snprintf(line, sizeof(line), "%.2f ms gpu (upload %.2f, acquire %.2f, trace %.2f, upscale %.2f, release %.2f), %.2f ms tick, %i bytes/frame", profile.GPUTime, p[0], p[1], p[2], p[3], p[4], profile.TickTime, profile.UploadBytes);
+				minecraft->Profile = StringSet(minecraft->Profile, line);
 				StringDestroy(chunks);
 				start += 1000;
 				frame = 0;
@@ -966,7 +1008,7 @@ void MinecraftPause(Minecraft minecraft)
 void MinecraftGenerateLevel(Minecraft minecraft, int size)
 {
 	char * user = "anonymous";
-	LevelGenerator generator = LevelGeneratorCreate(minecraft->ProgressBar);
+	LevelGenerator generator = LevelGeneratorCreate(minecraft->ProgressBar, TimeNano());
 	Level level = LevelGeneratorGenerate(generator, user, 128 << (size + 1), 128 << (size + 1), 64);
 	MinecraftSetLevel(minecraft, level);
 	LevelGeneratorDestroy(generator);
@@ -1031,12 +1073,17 @@ void MinecraftDestroy(Minecraft minecraft)
 	RendererDestroy(minecraft->Renderer);
 	LevelIODestroy(minecraft->LevelIO);
 	StringDestroy(minecraft->Debug);
+	StringDestroy(minecraft->Profile);
 	OctreeRendererDeinitialize();
 	MemoryFree(minecraft);
 }
 
 int main(int argc, char * argv[])
 {
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--benchmark") == 0) { return BenchmarkRun(argc, argv); }
+	}
 	Minecraft minecraft = MinecraftCreate(860, 480, false);
 	MinecraftRun(minecraft);
 	return 0;
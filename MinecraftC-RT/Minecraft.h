@@ -42,6 +42,7 @@ typedef struct Minecraft
 	GameSettings Settings;
 	bool Running;
 	String Debug;
+	String Profile;
 	bool HasMouse;
 	int LastClick;
 	bool Raining;
@@ -23,6 +23,7 @@ void ProgressBarDisplaySetTitle(ProgressBarDisplay display, char * title)
 	if (!display->Minecraft->Running) { LogFatal("\n"); }
 	
 	display->Title = title;
+	if (display->Minecraft->Window == NULL) { return; }
 	int a1 = display->Minecraft->Width * 240 / display->Minecraft->Height;
 	int a2 = display->Minecraft->Height * 240 / display->Minecraft->Height;
 	glClear(GL_DEPTH_BUFFER_BIT);
@@ -45,6 +46,7 @@ void ProgressBarDisplaySetText(ProgressBarDisplay display, char * text)
 void ProgressBarDisplaySetProgress(ProgressBarDisplay display, int progress)
 {
 	if (!display->Minecraft->Running) { LogFatal("\n"); }
+	if (display->Minecraft->Window == NULL) { return; }
 	
 	long time = TimeMilli();
 	if (time - display->Start < 0 || time - display->Start >= 20)
@@ -0,0 +1,788 @@
+#include <OpenGL.h>
+#include "CPURenderer.h"
+#include "../Utilities/Log.h"
+#include "../Utilities/Memory.h"
+#include "../Utilities/Time.h"
+
+#define Epsilon 0.0001f
+#define CloudHeight 256.0f
+#define CameraFocalLength (0.5f / tanf(70.0f * pi / 360.0f))
+#define LightDirection normalize3f((float3){ 1.0f, 1.0f, 0.5f })
+#define BlockTypeCloud 50
+#define TileSize 16
+#define PacketWidth 4
+#define PacketHeight 2
+#define PacketSize (PacketWidth * PacketHeight)
+#define PacketMargin 0.01f
+
+typedef float __attribute__((ext_vector_type(PacketSize))) float8;
+typedef int32_t __attribute__((ext_vector_type(PacketSize))) int8;
+
+struct CPURenderer CPURenderer = { 0 };
+
+typedef struct TraceWorld
+{
+	unsigned char * Blocks, * Heights;
+	int Width, Depth, Height;
+	unsigned int Steps, Rays;
+} TraceWorld;
+
+typedef struct Traversal
+{
+	float3 Ray, Origin, Inv, Delta, Next;
+	int3 Step, Voxel;
+	float Enter;
+	int Axis;
+} Traversal;
+
+static inline float Sign(float v) { return v > 0.0f ? 1.0f : (v < 0.0f ? -1.0f : 0.0f); }
+static inline float3 Sign3(float3 v) { return (float3){ Sign(v.x), Sign(v.y), Sign(v.z) }; }
+static inline float3 Floor3(float3 v) { return (float3){ floorf(v.x), floorf(v.y), floorf(v.z) }; }
+static inline float3 Min3(float3 a, float3 b) { return (float3){ fminf(a.x, b.x), fminf(a.y, b.y), fminf(a.z, b.z) }; }
+static inline float3 Max3(float3 a, float3 b) { return (float3){ fmaxf(a.x, b.x), fmaxf(a.y, b.y), fmaxf(a.z, b.z) }; }
+static inline float Fract(float v) { return fminf(v - floorf(v), 0x1.fffffep-1f); }
+static inline float Mix(float a, float b, float t) { return a + (b - a) * t; }
+
+static inline float8 Select8(int8 mask, float8 a, float8 b) { return (float8)(((int8)a & mask) | ((int8)b & ~mask)); }
+
+static inline bool Any8(int8 mask)
+{
+	for (int i = 0; i < PacketSize; i++) { if (mask[i]) { return true; } }
+	return false;
+}
+
+static float3 MatrixTransformPoint(Matrix4x4 l, float3 r)
+{
+	return (float3)
+	{
+		r.x * l.M00 + r.y * l.M01 + r.z * l.M02 + l.M03,
+		r.x * l.M10 + r.y * l.M11 + r.z * l.M12 + l.M13,
+		r.x * l.M20 + r.y * l.M21 + r.z * l.M22 + l.M23,
+	};
+}
+
+static float4 SampleTerrain(float2 uv)
+{
+	int w = CPURenderer.TerrainWidth, h = CPURenderer.TerrainHeight;
+	int x = (int)((uv.x - floorf(uv.x)) * w), y = (int)((uv.y - floorf(uv.y)) * h);
+	unsigned char * texel = CPURenderer.Terrain + ((y < h ? y : h - 1) * w + (x < w ? x : w - 1)) * 4;
+	return (float4){ texel[0], texel[1], texel[2], texel[3] } / 255.0f;
+}
+
+static void RayBox(float3 r, float3 o, float3 bmin, float3 bmax, float * enter, float * exit)
+{
+	float3 inv = 1.0f / r;
+	float3 t1 = (bmin - o) * inv;
+	float3 t2 = (bmax - o) * inv;
+	float3 tn = Min3(t1, t2);
+	float3 tf = Max3(t1, t2);
+	*enter = fmaxf(tn.x, fmaxf(tn.y, tn.z));
+	*exit = fminf(tf.x, fminf(tf.y, tf.z));
+}
+
+static bool RayPlaneIntersection(float3 ray, float3 origin, float3 normal, float3 center, float * dist)
+{
+	float d = dot3f(normal, ray);
+	if (fabsf(d) > Epsilon)
+	{
+		*dist = dot3f(center - origin, normal) / d;
+		return *dist >= 0.0f;
+	}
+	return false;
+}
+
+static float3 BoxNormal(float3 hit, float3 bmin, float3 bmax)
+{
+	float3 n = (hit - (bmin + bmax) / 2.0f) / (float3){ fabsf(bmin.x - bmax.x), fabsf(bmin.y - bmax.y), fabsf(bmin.z - bmax.z) } * (1.0f + Epsilon);
+	return normalize3f((float3){ roundf(n.x), roundf(n.y), roundf(n.z) });
+}
+
+static float4 Permute(float4 x)
+{
+	x = ((x * 34.0f) + 1.0f) * x;
+	return x - (float4){ floorf(x.x / 289.0f), floorf(x.y / 289.0f), floorf(x.z / 289.0f), floorf(x.w / 289.0f) } * 289.0f;
+}
+
+static float Noise(float3 p)
+{
+	float3 a = Floor3(p);
+	float3 d = p - a;
+	d = d * d * (3.0f - 2.0f * d);
+	float4 b = a.xxyy + (float4){ 0.0f, 1.0f, 0.0f, 1.0f };
+	float4 k1 = Permute(b.xyxy);
+	float4 k2 = Permute(k1.xyxy + b.zzww);
+	float4 c = k2 + a.zzzz;
+	float4 k3 = Permute(c) / 41.0f;
+	float4 k4 = Permute(c + 1.0f) / 41.0f;
+	float4 o1 = { Fract(k3.x), Fract(k3.y), Fract(k3.z), Fract(k3.w) };
+	float4 o2 = { Fract(k4.x), Fract(k4.y), Fract(k4.z), Fract(k4.w) };
+	float4 o3 = o2 * d.z + o1 * (1.0f - d.z);
+	float2 o4 = o3.yw * d.x + o3.xz * (1.0f - d.x);
+	return o4.y * d.y + o4.x * (1.0f - d.y);
+}
+
+static float CloudSDF(float3 p, float time)
+{
+	p -= time;
+	p /= 128.0f;
+	float n = 0.0f;
+	for (int i = 0; i < 5; i++) { n += Noise(powf(2.0f, i) * p) / powf(2.0f, i + 1.0f); }
+	return (2.0f * n - 0.75f) * 128.0f;
+}
+
+static float3 CloudNormal(float3 p, float time)
+{
+	float3 x = { 1.0f, 0.0f, 0.0f }, y = { 0.0f, 1.0f, 0.0f }, z = { 0.0f, 0.0f, 1.0f };
+	return normalize3f((float3){ CloudSDF(p + x, time) - CloudSDF(p - x, time), CloudSDF(p + y, time) - CloudSDF(p - y, time), CloudSDF(p + z, time) - CloudSDF(p - z, time) });
+}
+
+static float GetTileReflectiveness(unsigned char tile, float4 color)
+{
+	BlockMaterial * material = &Blocks.Materials[tile];
+	return material->Alpha != BlockAlphaMerged || color.w == 0.0f ? material->Reflectiveness : 0.0f;
+}
+
+static bool HasCrossPlaneCollision(unsigned char tile)
+{
+	return Blocks.Materials[tile].Shape == BlockShapeCross;
+}
+
+static float3 BGColor(float3 ray)
+{
+	float t = 1.0f - (1.0f - ray.y) * (1.0f - ray.y);
+	return t * (float3){ 0.63f, 0.8f, 1.0f } + (1.0f - t) * (float3){ 1.0f, 1.0f, 1.0f };
+}
+
+static float4 WaterColor(float3 hit)
+{
+	float3 f = hit - Floor3(hit);
+	return SampleTerrain(f.xz / 16.0f + (float2){ 224.0f / 256.0f, 0.0f });
+}
+
+static bool PointInBounds(TraceWorld * world, int3 v)
+{
+	return v.x >= 0 && v.y >= 0 && v.z >= 0 && v.x < world->Width && v.y < world->Depth && v.z < world->Height;
+}
+
+static unsigned char GetBlock(TraceWorld * world, int3 v)
+{
+	return world->Blocks[(v.y * world->Height + v.z) * world->Width + v.x];
+}
+
+static float4 CrossPlaneColor(unsigned char tile, float2 uv)
+{
+	int id = Blocks.Materials[tile].Faces[0];
+	return SampleTerrain(uv / 16.0f + (float2){ (id % 16) << 4, (id / 16) << 4 } / 256.0f);
+}
+
+static bool RayBlockIntersection(TraceWorld * world, float3 ray, float3 origin, bool ignoreWater, float time, int3 voxel, unsigned char tile, float3 hitExit, float3 * hit, float3 * normal, float4 * color)
+{
+	float3 base = float3i(voxel);
+	float3 dim = { 1.0f, 1.0f, 1.0f };
+	BlockMaterial * material = &Blocks.Materials[tile];
+	if (tile == BlockTypeNone) { return false; }
+	else if (material->Shape == BlockShapeLiquid)
+	{
+		if (ignoreWater) { return false; }
+		int3 up = voxel + (int3){ 0, 1, 0 };
+		unsigned char above = PointInBounds(world, up) ? GetBlock(world, up) : BlockTypeNone;
+		if (above != BlockTypeWater && above != BlockTypeStillWater)
+		{
+			float amp = 0.05f;
+			float freq = 1.0f;
+			base.y -= 0.05f + amp * (sinf(freq * (hit->x + hit->z) + time * 1.25f) * 0.5f + 0.5f);
+			float enter, exit;
+			RayBox(ray, origin, base, base + dim, &enter, &exit);
+			*hit = origin + ray * enter;
+			if (exit < enter || exit < 0.0f || enter < 0.0f) { return false; }
+			if (fabsf(hit->y - base.y - dim.y) < Epsilon)
+			{
+				float slope = 0.5f * amp * freq * cosf((hit->x + hit->z) * freq + time);
+				*normal = normalize3f((float3){ slope, 1.0f, slope });
+			}
+		}
+	}
+	else if (material->Shape == BlockShapeSlab)
+	{
+		dim.y = 0.5f;
+		float enter, exit;
+		RayBox(ray, origin, base, base + dim, &enter, &exit);
+		*hit = origin + ray * enter;
+		if (!((exit > enter && enter > 0.0f) || (exit > 0.0f && enter < 0.0f))) { return false; }
+		*normal = BoxNormal(*hit, base, base + dim);
+	}
+	else if (material->Alpha == BlockAlphaMerged)
+	{
+		int3 prevVoxel = int3f(*hit - Sign3(ray) * Epsilon);
+		unsigned char prev = PointInBounds(world, prevVoxel) ? GetBlock(world, prevVoxel) : BlockTypeNone;
+		if (prev == tile) { return false; }
+	}
+	else if (material->Shape == BlockShapeCross)
+	{
+		float2 center = base.xz + 0.5f;
+		float p1Dist = 0.0f, p2Dist = 0.0f;
+		float3 p1Hit = { 0.0f }, p2Hit = { 0.0f }, p1Normal = { 0.0f }, p2Normal = { 0.0f };
+		float4 p1Color = { 0.0f }, p2Color = { 0.0f };
+		RayPlaneIntersection(ray, *hit, normalize3f((float3){ 1.0f, 0.0f, 1.0f }), base + 0.5f, &p1Dist);
+		bool p1Intersect = !(p1Dist < 0.0f || p1Dist > distance3f(*hit, hitExit) || distance2f((*hit + ray * p1Dist).xz, center) > 0.5f);
+		RayPlaneIntersection(ray, *hit, normalize3f((float3){ 1.0f, 0.0f, -1.0f }), base + 0.5f, &p2Dist);
+		bool p2Intersect = !(p2Dist < 0.0f || p2Dist > distance3f(*hit, hitExit) || distance2f((*hit + ray * p2Dist).xz, center) > 0.5f);
+		if (!p1Intersect && !p2Intersect) { return false; }
+
+		if (p1Intersect)
+		{
+			p1Normal = (float3){ 1.0f, 0.0f, 1.0f } * (1.0f - hit->z + base.z > hit->x - base.x ? -1.0f : 1.0f);
+			p1Hit = *hit + ray * p1Dist;
+			p1Color = CrossPlaneColor(tile, (float2){ distance2f(base.xz + (float2){ 0.1464466f, 1.0f - 0.1464466f }, p1Hit.xz), 1.0f - (p1Hit.y - base.y) });
+			if (p1Color.w == 0.0f) { p1Intersect = false; }
+		}
+		if (p2Intersect)
+		{
+			p2Normal = (float3){ 1.0f, 0.0f, -1.0f } * (hit->z - base.z > hit->x - base.x ? -1.0f : 1.0f);
+			p2Hit = *hit + ray * p2Dist;
+			p2Color = CrossPlaneColor(tile, (float2){ 1.0f - distance2f(base.xz + (float2){ 0.1464466f, 0.1464466f }, p2Hit.xz), 1.0f - (p2Hit.y - base.y) });
+			if (p2Color.w == 0.0f) { p2Intersect = false; }
+		}
+
+		if (!p1Intersect && !p2Intersect) { return false; }
+		else if ((p1Intersect && !p2Intersect) || (p1Intersect && p2Intersect && p1Dist < p2Dist))
+		{
+			*normal = p1Normal;
+			*hit = p1Hit + p1Normal * Epsilon;
+			*color = p1Color;
+			return true;
+		}
+		else if ((!p1Intersect && p2Intersect) || (p1Intersect && p2Intersect && p2Dist < p1Dist))
+		{
+			*normal = p2Normal;
+			*hit = p2Hit + p2Normal * Epsilon;
+			*color = p2Color;
+			return true;
+		}
+		return false;
+	}
+
+	float2 uv = { 0.0f, 0.0f };
+	float3 n = *hit - base;
+	int side = 0;
+	if (fabsf(n.x) < Epsilon) { uv = (float2){ n.z, 1.0f - n.y }; side = 5; }
+	if (fabsf(n.x - dim.x) < Epsilon) { uv = (float2){ 1.0f - n.z, 1.0f - n.y }; side = 4; }
+	if (fabsf(n.y) < Epsilon) { uv = n.xz; side = 0; }
+	if (fabsf(n.y - dim.y) < Epsilon) { uv = n.xz; side = 1; }
+	if (fabsf(n.z) < Epsilon) { uv = (float2){ 1.0f - n.x, 1.0f - n.y }; side = 3; }
+	if (fabsf(n.z - dim.z) < Epsilon) { uv = (float2){ n.x, 1.0f - n.y }; side = 2; }
+	int id = material->Faces[side];
+	if (id == BlockTextureMissing) { *color = (float4){ 1.0f, 0.0f, 1.0f, 1.0f }; return true; }
+	*color = SampleTerrain(uv / 16.0f + (float2){ (id % 16) << 4, (id / 16) << 4 } / 256.0f);
+	if (material->Alpha == BlockAlphaCutout && color->w == 0.0f) { return false; }
+	if (material->Shape == BlockShapeLiquid) { hit->y += 0.1f; }
+	return true;
+}
+
+static float3 TraversalBoxExit(Traversal * t, int3 bmin, int3 bmax)
+{
+	float3 exit;
+	for (int i = 0; i < 3; i++) { exit[i] = t->Step[i] == 0 ? INFINITY : ((t->Step[i] > 0 ? bmax[i] : bmin[i]) - t->Origin[i]) * t->Inv[i]; }
+	return exit;
+}
+
+static void TraversalSetVoxel(Traversal * t, int3 voxel, float enter, int axis)
+{
+	t->Voxel = voxel;
+	t->Next = TraversalBoxExit(t, voxel, voxel + 1);
+	t->Enter = enter;
+	t->Axis = axis;
+}
+
+static void TraversalBegin(Traversal * t, float3 ray, float3 origin)
+{
+	t->Ray = ray;
+	t->Origin = origin;
+	t->Inv = 1.0f / ray;
+	t->Delta = (float3){ fabsf(t->Inv.x), fabsf(t->Inv.y), fabsf(t->Inv.z) };
+	t->Step = (int3){ (int)Sign(ray.x), (int)Sign(ray.y), (int)Sign(ray.z) };
+	int3 voxel = int3f(Floor3(origin));
+	float3 base = float3i(voxel);
+	float3 tn = Min3((base - origin) * t->Inv, (base + 1.0f - origin) * t->Inv);
+	for (int i = 0; i < 3; i++) { if (t->Step[i] == 0) { tn[i] = -INFINITY; } }
+	int axis = tn.x >= tn.y && tn.x >= tn.z ? 0 : (tn.y >= tn.z ? 1 : 2);
+	TraversalSetVoxel(t, voxel, fmaxf(tn.x, fmaxf(tn.y, tn.z)), axis);
+}
+
+static float TraversalExit(Traversal * t)
+{
+	return fminf(t->Next.x, fminf(t->Next.y, t->Next.z));
+}
+
+static float3 TraversalNormal(Traversal * t)
+{
+	float3 normal = { 0.0f, 0.0f, 0.0f };
+	normal[t->Axis] = -t->Step[t->Axis];
+	return normal;
+}
+
+static void TraversalStep(Traversal * t)
+{
+	int axis = t->Next.x < t->Next.y && t->Next.x < t->Next.z ? 0 : (t->Next.y < t->Next.z ? 1 : 2);
+	t->Enter = t->Next[axis];
+	t->Next[axis] += t->Delta[axis];
+	t->Voxel[axis] += t->Step[axis];
+	t->Axis = axis;
+}
+
+static void TraversalSkip(Traversal * t, int3 bmin, int3 bmax)
+{
+	float3 exit = TraversalBoxExit(t, bmin, bmax);
+	int axis = exit.x < exit.y && exit.x < exit.z ? 0 : (exit.y < exit.z ? 1 : 2);
+	float enter = fminf(exit.x, fminf(exit.y, exit.z));
+	int3 voxel = int3f(Floor3(t->Origin + t->Ray * enter));
+	for (int i = 0; i < 3; i++) { voxel[i] = voxel[i] < bmin[i] ? bmin[i] : (voxel[i] > bmax[i] - 1 ? bmax[i] - 1 : voxel[i]); }
+	voxel[axis] = t->Step[axis] > 0 ? bmax[axis] : bmin[axis] - 1;
+	TraversalSetVoxel(t, voxel, enter, axis);
+}
+
+static bool SkipEmptySpace(TraceWorld * world, Traversal * t)
+{
+	int height = world->Heights[t->Voxel.z * world->Width + t->Voxel.x];
+	if (t->Voxel.y < height) { return false; }
+	int3 emptyMin = { t->Voxel.x, height, t->Voxel.z }, emptyMax = { t->Voxel.x + 1, world->Depth, t->Voxel.z + 1 };
+	if (emptyMax.y <= emptyMin.y) { return false; }
+	float3 exit = TraversalBoxExit(t, emptyMin, emptyMax);
+	if (fminf(exit.x, fminf(exit.y, exit.z)) <= TraversalExit(t)) { return false; }
+	TraversalSkip(t, emptyMin, emptyMax);
+	return true;
+}
+
+static bool RayWorldIntersection(TraceWorld * world, Traversal * t, bool ignoreWater, float time, int3 * voxel, float3 * hit, float3 * hitExit, unsigned char * tile, float3 * normal, float4 * color)
+{
+	float3 ray = t->Ray, origin = t->Origin;
+	if (!PointInBounds(world, t->Voxel))
+	{
+		*hit = *hitExit;
+		return false;
+	}
+	while (PointInBounds(world, t->Voxel))
+	{
+		world->Steps++;
+		if (SkipEmptySpace(world, t)) { continue; }
+
+		*voxel = t->Voxel;
+		*tile = GetBlock(world, *voxel);
+		*hit = origin + ray * (HasCrossPlaneCollision(*tile) ? fmaxf(t->Enter, 0.0f) : t->Enter);
+		*hitExit = origin + ray * TraversalExit(t) + Sign3(ray) * Epsilon;
+		*normal = TraversalNormal(t);
+
+		bool found = RayBlockIntersection(world, ray, origin, ignoreWater, time, *voxel, *tile, *hitExit, hit, normal, color);
+		TraversalStep(t);
+		if (found) { return true; }
+	}
+	*hit = origin + ray * fmaxf(t->Enter, 0.0f);
+	*hitExit = t->Enter > 0.0f ? *hit + Sign3(ray) * Epsilon : origin;
+	return false;
+}
+
+static bool RaySceneIntersection(TraceWorld * world, Traversal * t, bool ignoreWater, float time, int3 * voxel, float3 * hit, float3 * hitExit, unsigned char * tile, float3 * normal, float4 * color)
+{
+	float3 ray = t->Ray, origin = *hitExit;
+	if (RayWorldIntersection(world, t, ignoreWater, time, voxel, hit, hitExit, tile, normal, color)) { return true; }
+
+	float dist;
+	if (RayPlaneIntersection(ray, *hitExit, (float3){ 0.0f, -1.0f, 0.0f }, (float3){ 0.0f, CloudHeight, 0.0f }, &dist))
+	{
+		*hit = *hitExit + ray * dist;
+		if (CloudSDF(*hit, time) < Epsilon)
+		{
+			*hitExit = *hit;
+			*tile = BlockTypeCloud;
+			*normal = CloudNormal(*hit, time);
+			*color = (float4){ 1.0f, 1.0f, 1.0f, 1.0f };
+			return true;
+		}
+		return false;
+	}
+	if (!ignoreWater && RayPlaneIntersection(ray, *hitExit, (float3){ 0.0f, 1.0f, 0.0f }, (float3){ 0.0f, 31.9f, 0.0f }, &dist))
+	{
+		*hit = *hitExit + ray * dist;
+		*hitExit = *hit + Sign3(ray) * Epsilon;
+		*tile = BlockTypeWater;
+		*normal = (float3){ 0.0f, 1.0f, 0.0f };
+		*color = WaterColor(*hit);
+		return true;
+	}
+	if (RayPlaneIntersection(ray, *hitExit, (float3){ 0.0f, 1.0f, 0.0f }, (float3){ 0.0f, 0.0f, 0.0f }, &dist))
+	{
+		*hit = origin + ray * dist;
+		*hitExit = *hit + Sign3(ray) * Epsilon;
+		*tile = BlockTypeBedrock;
+		*normal = (float3){ 0.0f, 1.0f, 0.0f };
+		*color = (float4){ 0.0f, 0.0f, 0.0f, 1.0f };
+		return true;
+	}
+	return false;
+}
+
+static float3 TraceLighting(float3 color, float3 lightDir, float3 normal, float3 ray)
+{
+	float specularStrength = 0.1f;
+	float3 lightColor = { 1.0f, 0.95f, 0.8f };
+	float3 reflect = normalize3f(lightDir - 2.0f * dot3f(lightDir, normal) * normal);
+	float3 ambient = { 0.2f, 0.2f, 0.1f };
+	float3 diffuse = (fmaxf(dot3f(normal, lightDir), -1.0f) * 0.375f + 0.625f) * lightColor;
+	float3 specular = specularStrength * powf(fmaxf(dot3f(ray, reflect), 0.0f), 4.0f) * lightColor;
+	return (ambient + diffuse + specular) * color;
+}
+
+static float4 ShadowTransmittance(TraceWorld * world, float3 lightDir, float3 exit, bool inWater, float3 waterEntry, float time)
+{
+	float4 shadowColor = { 0.0f, 0.0f, 0.0f, 1.0f };
+	float4 hitColor = { 0.0f, 0.0f, 0.0f, 0.0f };
+	float3 shadowHit, normal;
+	int3 voxel;
+	unsigned char tile = 0;
+	Traversal t;
+	TraversalBegin(&t, lightDir, exit);
+	while (hitColor.w < 1.0f && RaySceneIntersection(world, &t, inWater, time, &voxel, &shadowHit, &exit, &tile, &normal, &hitColor))
+	{
+		if (inWater)
+		{
+			if (tile == BlockTypeWater || tile == BlockTypeStillWater) { continue; }
+			else { shadowColor.w *= 1.0f - fminf(distance3f(shadowHit, waterEntry) / 10.0f, 1.0f); }
+		}
+		float w = tile == BlockTypeCloud ? 0.05f : hitColor.w;
+		shadowColor.xyz += hitColor.xyz * w * shadowColor.w;
+		shadowColor.w *= 1.0f - w;
+		if (!inWater && (tile == BlockTypeWater || tile == BlockTypeStillWater))
+		{
+			inWater = true;
+			waterEntry = shadowHit;
+		}
+	}
+	return shadowColor;
+}
+
+static float3 TraceShadows(float3 color, float3 lightDir, TraceWorld * world, float3 hit, bool inWater, float3 waterEntry, float time, unsigned char tile)
+{
+	world->Rays++;
+	float3 exit = hit + (HasCrossPlaneCollision(tile) ? 0.0f : Epsilon) * lightDir;
+	float4 shadowColor = ShadowTransmittance(world, lightDir, exit, inWater, inWater ? waterEntry : hit, time);
+	return color * shadowColor.w + (shadowColor.xyz * shadowColor.w + 0.375f * color * (1.0f - shadowColor.w)) * (1.0f - shadowColor.w);
+}
+
+static float4 TraceFog(float3 hit, float3 origin, float3 ray)
+{
+	float d = distance3f(hit, origin);
+	float w = d < 1024.0f ? fminf(fmaxf(d / 256.0f, 0.0f), 0.6f) : 0.4f * fminf(fmaxf((d - 1024.0f) / 1024.0f, 0.0f), 1.0f) + 0.6f;
+	float3 bg = BGColor(ray);
+	return (float4){ bg.x, bg.y, bg.z, w };
+}
+
+static float3 TraceReflections(float3 normal, TraceWorld * world, float3 hit, float3 ray, float3 lightDir, float time)
+{
+	world->Rays++;
+	float4 reflectionColor = { 0.0f, 0.0f, 0.0f, 1.0f };
+	float4 hitColor = { 0.0f, 0.0f, 0.0f, 0.0f };
+	float3 rRay = normalize3f(ray - 2.0f * dot3f(ray, normal) * normal);
+	float3 exit = hit + Epsilon * rRay;
+	float3 rHit, rNormal;
+	int3 voxel;
+	unsigned char tile = 0;
+	bool inWater = false;
+	float3 waterEntry = hit;
+	Traversal t;
+	TraversalBegin(&t, rRay, exit);
+	while (hitColor.w < 1.0f)
+	{
+		if (RaySceneIntersection(world, &t, inWater, time, &voxel, &rHit, &exit, &tile, &rNormal, &hitColor))
+		{
+			if (inWater)
+			{
+				if (tile == BlockTypeWater || tile == BlockTypeStillWater) { continue; }
+				else { reflectionColor.w *= 1.0f - fminf(distance3f(rHit, waterEntry) / 10.0f, 1.0f); }
+			}
+			hitColor.xyz = TraceLighting(hitColor.xyz, lightDir, rNormal, ray);
+			hitColor.xyz = TraceShadows(hitColor.xyz, lightDir, world, rHit, inWater, waterEntry, time, tile);
+			float4 fog = TraceFog(rHit, hit, rRay);
+			reflectionColor.xyz += fog.xyz * fog.w * reflectionColor.w;
+			reflectionColor.w *= 1.0f - fog.w;
+			reflectionColor.xyz += hitColor.xyz * hitColor.w * reflectionColor.w;
+			reflectionColor.w *= 1.0f - hitColor.w;
+			if (!inWater && (tile == BlockTypeWater || tile == BlockTypeStillWater))
+			{
+				inWater = true;
+				waterEntry = rHit;
+			}
+		}
+		else
+		{
+			if (inWater) { reflectionColor.w *= 1.0f - fminf(distance3f(rHit, waterEntry) / 10.0f, 1.0f); }
+			reflectionColor.xyz += BGColor(rRay) * reflectionColor.w;
+			break;
+		}
+	}
+	return reflectionColor.xyz;
+}
+
+static float4 CameraRay(int x, int y, int width, int height, float3 origin, float3 * ray)
+{
+	float time = CPURenderer.Time;
+	float2 uv = { 1.0f - 2.0f * x / width, 2.0f * y / height - 1.0f };
+	uv.x *= (float)width / height;
+	if (CPURenderer.UnderWater) { uv.y += sinf(uv.x * (10.0f + sinf(time)) + time) / (70.0f + 10.0f * sinf(time)); }
+	*ray = normalize3f(MatrixTransformPoint(CPURenderer.Camera, (float3){ uv.x * 0.5f, uv.y * 0.5f, CameraFocalLength }) - origin);
+	float4 fragColor = { 0.0f, 0.0f, 0.0f, 1.0f };
+	if (CPURenderer.UnderWater)
+	{
+		float4 water = SampleTerrain((float2){ x / (float)width, y / (float)height } / 16.0f + (float2){ 224.0f / 256.0f, 0.0f });
+		water.w *= 0.375f;
+		fragColor.xyz += water.xyz * water.w * fragColor.w;
+		fragColor.w *= 1.0f - water.w;
+	}
+	return fragColor;
+}
+
+static void PacketStartDistances(TraceWorld * world, float3 origin, float3 * rays, float * starts)
+{
+	for (int i = 0; i < PacketSize; i++) { starts[i] = 0.0f; }
+	int3 cell = int3f(Floor3(origin));
+	if (!PointInBounds(world, cell)) { return; }
+
+	float8 d[3], next[3], delta[3];
+	int8 step[3], voxel[3];
+	for (int i = 0; i < PacketSize; i++)
+	{
+		for (int j = 0; j < 3; j++) { d[j][i] = rays[i][j]; }
+	}
+	for (int j = 0; j < 3; j++)
+	{
+		float8 inv = 1.0f / d[j];
+		step[j] = (int8)(d[j] < 0.0f) - (int8)(d[j] > 0.0f);
+		float8 boundary = (float8)cell[j] + Select8(step[j] > 0, (float8)1.0f, (float8)0.0f) - origin[j];
+		next[j] = Select8(step[j] != 0, boundary * inv, (float8)INFINITY);
+		delta[j] = Select8(inv < 0.0f, -inv, inv);
+		voxel[j] = (int8)cell[j];
+	}
+
+	float8 enter = 0.0f, start = 0.0f;
+	int8 active = (int8)-1;
+	while (Any8(active))
+	{
+		int8 inside = (voxel[0] >= 0) & (voxel[1] >= 0) & (voxel[2] >= 0) & (voxel[0] < world->Width) & (voxel[1] < world->Depth) & (voxel[2] < world->Height);
+		int8 index = (voxel[1] * world->Height + voxel[2]) * world->Width + voxel[0];
+		int8 solid = ~inside;
+		for (int i = 0; i < PacketSize; i++)
+		{
+			if (active[i] & inside[i]) { solid[i] = world->Blocks[index[i]] != BlockTypeNone ? -1 : 0; }
+			world->Steps += active[i] & 1;
+		}
+		int8 stopped = solid & active;
+		start = Select8(stopped, enter - PacketMargin, start);
+		active &= ~stopped;
+		int8 stepX = (next[0] < next[1]) & (next[0] < next[2]) & active;
+		int8 stepY = ~stepX & (next[1] < next[2]) & active;
+		int8 stepZ = ~stepX & ~stepY & active;
+		enter = Select8(stepX, next[0], Select8(stepY, next[1], Select8(stepZ, next[2], enter)));
+		int8 masks[3] = { stepX, stepY, stepZ };
+		for (int j = 0; j < 3; j++)
+		{
+			next[j] += Select8(masks[j], delta[j], (float8)0.0f);
+			voxel[j] += step[j] & masks[j];
+		}
+	}
+	for (int i = 0; i < PacketSize; i++) { starts[i] = fmaxf(start[i], 0.0f); }
+}
+
+static float4 TraceRay(TraceWorld * world, float4 fragColor, float3 origin, float3 ray, float start)
+{
+	float time = CPURenderer.Time;
+	float3 lightDir = LightDirection;
+	float4 hitColor = { 0.0f, 0.0f, 0.0f, 0.0f };
+	float3 exit = origin + ray * start, hit, normal;
+	int3 voxel;
+	unsigned char tile = 0;
+	bool inWater = CPURenderer.UnderWater;
+	float3 waterEntry = origin;
+	Traversal t;
+	TraversalBegin(&t, ray, exit);
+	world->Rays++;
+	while (hitColor.w < 1.0f)
+	{
+		if (RaySceneIntersection(world, &t, inWater, time, &voxel, &hit, &exit, &tile, &normal, &hitColor))
+		{
+			if (inWater)
+			{
+				if (tile == BlockTypeWater || tile == BlockTypeStillWater) { continue; }
+				else { fragColor.w *= 1.0f - fminf(distance3f(hit, waterEntry) / 10.0f, 1.0f); }
+			}
+			hitColor.xyz = TraceLighting(hitColor.xyz, lightDir, normal, ray);
+			hitColor.xyz = TraceShadows(hitColor.xyz, lightDir, world, hit, inWater, waterEntry, time, tile);
+			float4 fog = TraceFog(hit, origin, ray);
+			fragColor.xyz += fog.xyz * fog.w * fragColor.w;
+			fragColor.w *= 1.0f - fog.w;
+			float reflectiveness = GetTileReflectiveness(tile, hitColor);
+			if (reflectiveness > 0.0f)
+			{
+				float3 rColor = TraceReflections(normal, world, hit, ray, lightDir, time);
+				fragColor.xyz += rColor * reflectiveness * fragColor.w;
+				fragColor.w *= 1.0f - reflectiveness;
+			}
+			fragColor.xyz += hitColor.xyz * hitColor.w * fragColor.w;
+			fragColor.w *= 1.0f - hitColor.w;
+
+			if (!inWater && (tile == BlockTypeWater || tile == BlockTypeStillWater))
+			{
+				inWater = true;
+				waterEntry = hit;
+				if (normal.y > 0.0f)
+				{
+					ray = normalize3f(ray - 2.0f * dot3f(ray, normal) * normal) * (float3){ 1.0f, -1.0f, 1.0f };
+					exit = hit + distance3f(hit, exit) * ray;
+					TraversalBegin(&t, ray, exit);
+				}
+			}
+		}
+		else
+		{
+			if (inWater) { fragColor.w *= 1.0f - fminf(distance3f(hit, waterEntry) / 10.0f, 1.0f); }
+			fragColor.xyz += BGColor(ray) * fragColor.w;
+			break;
+		}
+	}
+	return fragColor;
+}
+
+static void RenderTile(TraceWorld * world, int tile)
+{
+	int w = CPURenderer.Width, h = CPURenderer.Height;
+	int tilesX = (w + TileSize - 1) / TileSize;
+	int x0 = (tile % tilesX) * TileSize, y0 = (tile / tilesX) * TileSize;
+	float3 origin = MatrixTransformPoint(CPURenderer.Camera, (float3){ 0.0f, 0.0f, 0.0f });
+	for (int py = y0; py < y0 + TileSize && py < h; py += PacketHeight)
+	{
+		for (int px = x0; px < x0 + TileSize && px < w; px += PacketWidth)
+		{
+			float3 rays[PacketSize];
+			float4 colors[PacketSize];
+			float starts[PacketSize];
+			for (int i = 0; i < PacketSize; i++) { colors[i] = CameraRay(px + i % PacketWidth, py + i / PacketWidth, w, h, origin, &rays[i]); }
+			PacketStartDistances(world, origin, rays, starts);
+			for (int i = 0; i < PacketSize; i++)
+			{
+				int x = px + i % PacketWidth, y = py + i / PacketWidth;
+				if (x >= w || y >= h) { continue; }
+				float4 color = TraceRay(world, colors[i], origin, rays[i], starts[i]);
+				unsigned char * pixel = CPURenderer.Pixels + (y * w + x) * 4;
+				for (int j = 0; j < 3; j++) { pixel[j] = (unsigned char)(fminf(fmaxf(color[j], 0.0f), 1.0f) * 255.0f + 0.5f); }
+				pixel[3] = 255;
+			}
+		}
+	}
+}
+
+static void RenderTiles()
+{
+	Level level = CPURenderer.Level;
+	TraceWorld world = { .Blocks = level->Blocks, .Heights = CPURenderer.Heights, .Width = level->Width, .Depth = level->Depth, .Height = level->Height };
+	int tileCount = ((CPURenderer.Width + TileSize - 1) / TileSize) * ((CPURenderer.Height + TileSize - 1) / TileSize);
+	for (int tile = SDL_AtomicAdd(&CPURenderer.NextTile, 1); tile < tileCount; tile = SDL_AtomicAdd(&CPURenderer.NextTile, 1)) { RenderTile(&world, tile); }
+	SDL_AtomicAdd(&CPURenderer.Steps, world.Steps);
+	SDL_AtomicAdd(&CPURenderer.Rays, world.Rays);
+}
+
+static int RenderWorker(void * data)
+{
+	while (true)
+	{
+		SDL_SemWait(CPURenderer.Start);
+		if (CPURenderer.Quit) { return 0; }
+		RenderTiles();
+		SDL_SemPost(CPURenderer.Done);
+	}
+}
+
+void CPURendererInitialize()
+{
+	CPURenderer.ThreadCount = SDL_GetCPUCount() > 1 ? SDL_GetCPUCount() - 1 : 0;
+	CPURenderer.Start = SDL_CreateSemaphore(0);
+	CPURenderer.Done = SDL_CreateSemaphore(0);
+	CPURenderer.Threads = MemoryAllocate((CPURenderer.ThreadCount + 1) * sizeof(SDL_Thread *));
+	for (int i = 0; i < CPURenderer.ThreadCount; i++)
+	{
+		CPURenderer.Threads[i] = SDL_CreateThread(RenderWorker, "CPURenderer", NULL);
+		if (CPURenderer.Threads[i] == NULL) { LogFatal("Failed to create render thread: %s\n", SDL_GetError()); }
+	}
+	LogInfo("CPU renderer running on %i threads with %i-wide ray packets\n", CPURenderer.ThreadCount + 1, PacketSize);
+}
+
+static void ReadTerrain(unsigned int terrain)
+{
+	int width, height;
+	glBindTexture(GL_TEXTURE_2D, terrain);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+	if (width != CPURenderer.TerrainWidth || height != CPURenderer.TerrainHeight)
+	{
+		if (CPURenderer.Terrain != NULL) { MemoryFree(CPURenderer.Terrain); }
+		CPURenderer.Terrain = MemoryAllocate(width * height * 4);
+		CPURenderer.TerrainWidth = width;
+		CPURenderer.TerrainHeight = height;
+	}
+	glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, CPURenderer.Terrain);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+static void ResizePixels(int width, int height, int frameWidth, int frameHeight)
+{
+	if (width == CPURenderer.Width && height == CPURenderer.Height && frameWidth == CPURenderer.FrameWidth && frameHeight == CPURenderer.FrameHeight) { return; }
+	if (CPURenderer.Pixels != NULL) { MemoryFree(CPURenderer.Pixels); }
+	if (CPURenderer.FramePixels != NULL) { MemoryFree(CPURenderer.FramePixels); }
+	CPURenderer.Pixels = MemoryAllocate(width * height * 4);
+	CPURenderer.FramePixels = MemoryAllocate(frameWidth * frameHeight * 4);
+	CPURenderer.Width = width;
+	CPURenderer.Height = height;
+	CPURenderer.FrameWidth = frameWidth;
+	CPURenderer.FrameHeight = frameHeight;
+}
+
+void CPURendererRender(Level level, unsigned char * heights, Matrix4x4 camera, bool isUnderWater, float time, unsigned int terrain, unsigned int texture, int width, int height, int frameWidth, int frameHeight)
+{
+	uint64_t start = TimeNano();
+	ResizePixels(width, height, frameWidth, frameHeight);
+	ReadTerrain(terrain);
+	CPURenderer.Level = level;
+	CPURenderer.Heights = heights;
+	CPURenderer.Camera = camera;
+	CPURenderer.UnderWater = isUnderWater;
+	CPURenderer.Time = time;
+	SDL_AtomicSet(&CPURenderer.NextTile, 0);
+	SDL_AtomicSet(&CPURenderer.Steps, 0);
+	SDL_AtomicSet(&CPURenderer.Rays, 0);
+	for (int i = 0; i < CPURenderer.ThreadCount; i++) { SDL_SemPost(CPURenderer.Start); }
+	RenderTiles();
+	for (int i = 0; i < CPURenderer.ThreadCount; i++) { SDL_SemWait(CPURenderer.Done); }
+
+	for (int y = 0; y < frameHeight; y++)
+	{
+		unsigned char * row = CPURenderer.Pixels + (y * height / frameHeight) * width * 4;
+		for (int x = 0; x < frameWidth; x++) { memcpy(CPURenderer.FramePixels + (y * frameWidth + x) * 4, row + (x * width / frameWidth) * 4, 4); }
+	}
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, frameWidth, frameHeight, GL_RGBA, GL_UNSIGNED_BYTE, CPURenderer.FramePixels);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	int rays = SDL_AtomicGet(&CPURenderer.Rays);
+	CPURenderer.StepsPerRay = rays > 0 ? (float)SDL_AtomicGet(&CPURenderer.Steps) / rays : 0.0;
+	CPURenderer.RenderTime = (TimeNano() - start) / 1000000.0;
+}
+
+void CPURendererDeinitialize()
+{
+	CPURenderer.Quit = true;
+	for (int i = 0; i < CPURenderer.ThreadCount; i++) { SDL_SemPost(CPURenderer.Start); }
+	for (int i = 0; i < CPURenderer.ThreadCount; i++) { SDL_WaitThread(CPURenderer.Threads[i], NULL); }
+	MemoryFree(CPURenderer.Threads);
+	SDL_DestroySemaphore(CPURenderer.Start);
+	SDL_DestroySemaphore(CPURenderer.Done);
+	if (CPURenderer.Pixels != NULL) { MemoryFree(CPURenderer.Pixels); }
+	if (CPURenderer.FramePixels != NULL) { MemoryFree(CPURenderer.FramePixels); }
+	if (CPURenderer.Terrain != NULL) { MemoryFree(CPURenderer.Terrain); }
+}
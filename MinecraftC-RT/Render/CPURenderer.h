@@ -0,0 +1,27 @@
+#pragma once
+#include <SDL2/SDL.h>
+#include "../Level/Level.h"
+#include "../Utilities/LinearMath.h"
+
+struct CPURenderer
+{
+	int ThreadCount;
+	SDL_Thread ** Threads;
+	SDL_sem * Start, * Done;
+	SDL_atomic_t NextTile, Steps, Rays;
+	bool Quit;
+	int Width, Height, FrameWidth, FrameHeight;
+	unsigned char * Pixels, * FramePixels;
+	int TerrainWidth, TerrainHeight;
+	unsigned char * Terrain;
+	Level Level;
+	unsigned char * Heights;
+	Matrix4x4 Camera;
+	bool UnderWater;
+	float Time;
+	float StepsPerRay, RenderTime;
+} extern CPURenderer;
+
+void CPURendererInitialize(void);
+void CPURendererRender(Level level, unsigned char * heights, Matrix4x4 camera, bool isUnderWater, float time, unsigned int terrain, unsigned int texture, int width, int height, int frameWidth, int frameHeight);
+void CPURendererDeinitialize(void);
@@ -1,30 +1,591 @@
 #include <SDL2/SDL.h>
 #include <OpenGL.h>
+#include <stb_image.h>
 #include "OctreeRenderer.h"
+#include "CPURenderer.h"
 #include "../Level/Level.h"
 #include "../Player/Player.h"
 #include "../Utilities/Log.h"
 #include "../Utilities/Memory.h"
+#include "../Utilities/Time.h"
+
+#define DistanceFieldMax 15
+#define BrickUniform 0x80000000u
+#define BeamTileSize 8
+#define RenderScaleMin 0.5
+#define RenderScaleStep 0.125
+#define CloudLayerSize 1024
+#define CloudTexelSize 2.0
+#define CloudRecenterDistance 256.0
+#define LightDirection (float3){ 1.0, 1.0, 0.5 }
+#define DirtyRangeGap 64
+#define GroupSizeRuns 3
+#define SunEntries 4
+#define WavefrontGroupSize 8
+#define WavefrontBounceMax 32
+#define PersistentTileSize 8
+#define PersistentGroupsPerUnit 4
+#define SplitDeviceMax 4
+#define SplitShareMin 0.05
+#define SplitBandSlack 0.125
+#define ShaderFeatures "-DENABLE_REFLECTIONS -DENABLE_SHADOWS -DENABLE_CLOUDS -DLEVEL_HEIGHT=64"
 
 struct OctreeRenderer OctreeRenderer = { 0 };
 
-void OctreeRendererInitialize(TextureManager textures, int width, int height)
+static const char * TraceVariantOptions[] = { ShaderFeatures " -DUNDERWATER=0", ShaderFeatures " -DUNDERWATER=1" };
+static const char * WavefrontKernelNames[] = { "generatePaths", "extendPaths", "shadePaths", "shadowPaths", "reflectPaths", "resolvePaths" };
+
+static void ReleaseWavefront()
 {
-	OctreeRenderer.Width = width;
-	OctreeRenderer.Height = height;
-	OctreeRenderer.TextureManager = textures;
-	glGenTextures(1, &OctreeRenderer.TextureID);
-	glBindTexture(GL_TEXTURE_2D, OctreeRenderer.TextureID);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	if (OctreeRenderer.PathBuffer == NULL) { return; }
+	clFinish(OctreeRenderer.Queue);
+	clReleaseMemObject(OctreeRenderer.PathBuffer);
+	clReleaseMemObject(OctreeRenderer.PathQueues[0]);
+	clReleaseMemObject(OctreeRenderer.PathQueues[1]);
+	clReleaseMemObject(OctreeRenderer.ShadeQueue);
+	clReleaseMemObject(OctreeRenderer.ShadowQueue);
+	clReleaseMemObject(OctreeRenderer.ReflectQueue);
+	clReleaseMemObject(OctreeRenderer.QueueCounters);
+	OctreeRenderer.PathBuffer = NULL;
+}
+
+static void CreateWavefront()
+{
+	int error;
+	size_t pixels = OctreeRenderer.Width * OctreeRenderer.Height;
+	OctreeRenderer.PathBuffer = clCreateBuffer(OctreeRenderer.Context, CL_MEM_READ_WRITE, pixels * 12 * sizeof(cl_float4), NULL, &error);
+	if (error < 0) { LogFatal("Failed to create path buffer: %i\n", error); }
+	cl_mem * queues[] = { &OctreeRenderer.PathQueues[0], &OctreeRenderer.PathQueues[1], &OctreeRenderer.ShadeQueue, &OctreeRenderer.ShadowQueue, &OctreeRenderer.ReflectQueue };
+	for (int i = 0; i < sizeof(queues) / sizeof(queues[0]); i++)
+	{
+		*queues[i] = clCreateBuffer(OctreeRenderer.Context, CL_MEM_READ_WRITE, pixels * sizeof(cl_uint), NULL, &error);
+		if (error < 0) { LogFatal("Failed to create path queue: %i\n", error); }
+	}
+	OctreeRenderer.QueueCounters = clCreateBuffer(OctreeRenderer.Context, CL_MEM_READ_WRITE, 4 * (WavefrontBounceMax + 1) * sizeof(cl_uint), NULL, &error);
+	if (error < 0) { LogFatal("Failed to create queue counters: %i\n", error); }
+	
+	cl_kernel resolve = OctreeRenderer.WavefrontKernels[WavefrontStageResolve];
+	error = clSetKernelArg(resolve, 0, sizeof(cl_mem), &OctreeRenderer.PathBuffer);
+	error |= clSetKernelArg(resolve, 1, sizeof(cl_mem), &OctreeRenderer.RenderImage);
+	error |= clSetKernelArg(resolve, 2, sizeof(int), &OctreeRenderer.Width);
+	error |= clSetKernelArg(resolve, 3, sizeof(int), &OctreeRenderer.Height);
+	if (error < 0) { LogFatal("Failed to set kernel arguments: %i\n", error); }
+}
+
+static void CreateScreenBuffers()
+{
+	int error;
+	int tiles = ((OctreeRenderer.Width + BeamTileSize - 1) / BeamTileSize) * ((OctreeRenderer.Height + BeamTileSize - 1) / BeamTileSize);
+	OctreeRenderer.StartBuffer = clCreateBuffer(OctreeRenderer.Context, CL_MEM_READ_WRITE, tiles * sizeof(float), NULL, &error);
+	if (error < 0) { LogFatal("Failed to create beam buffer: %i\n", error); }
+	OctreeRenderer.DepthBuffer = clCreateBuffer(OctreeRenderer.Context, CL_MEM_READ_WRITE, OctreeRenderer.Width * OctreeRenderer.Height * sizeof(float), NULL, &error);
+	if (error < 0) { LogFatal("Failed to create depth buffer: %i\n", error); }
+	OctreeRenderer.HintBuffer = clCreateBuffer(OctreeRenderer.Context, CL_MEM_READ_WRITE, OctreeRenderer.Width * OctreeRenderer.Height * sizeof(cl_uint), NULL, &error);
+	if (error < 0) { LogFatal("Failed to create hint buffer: %i\n", error); }
+	if (OctreeRenderer.Heatmap != RayHeatmapOff)
+	{
+		OctreeRenderer.CounterBuffer = clCreateBuffer(OctreeRenderer.Context, CL_MEM_READ_WRITE, OctreeRenderer.Width * OctreeRenderer.Height * sizeof(cl_uint4), NULL, &error);
+		if (error < 0) { LogFatal("Failed to create counter buffer: %i\n", error); }
+	}
+	OctreeRenderer.HistoryValid = false;
+}
+
+static void ReleaseScreenBuffers()
+{
+	clFinish(OctreeRenderer.Queue);
+	clReleaseMemObject(OctreeRenderer.StartBuffer);
+	clReleaseMemObject(OctreeRenderer.DepthBuffer);
+	clReleaseMemObject(OctreeRenderer.HintBuffer);
+	if (OctreeRenderer.CounterBuffer != NULL) { clReleaseMemObject(OctreeRenderer.CounterBuffer); }
+	OctreeRenderer.CounterBuffer = NULL;
+}
+
+static void ResetDirtyRegion()
+{
+	OctreeRenderer.DirtyMin = (float3){ INFINITY, INFINITY, INFINITY };
+	OctreeRenderer.DirtyMax = (float3){ -INFINITY, -INFINITY, -INFINITY };
+}
+
+static void CreateOutputTextures()
+{
+	if (OctreeRenderer.Headless) { return; }
+	glGenTextures(2, OctreeRenderer.TextureIDs);
+	for (int i = 0; i < 2; i++)
+	{
+		glBindTexture(GL_TEXTURE_2D, OctreeRenderer.TextureIDs[i]);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, OctreeRenderer.FrameWidth, OctreeRenderer.FrameHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	}
 	glBindTexture(GL_TEXTURE_2D, 0);
+	OctreeRenderer.TextureID = OctreeRenderer.TextureIDs[0];
+}
+
+static void CreateOutputImages()
+{
+	if (OctreeRenderer.Context == NULL) { return; }
+	int error;
+	for (int i = 0; i < 2; i++)
+	{
+		if (OctreeRenderer.Headless)
+		{
+			cl_image_desc description = { .image_type = CL_MEM_OBJECT_IMAGE2D, .image_width = OctreeRenderer.FrameWidth, .image_height = OctreeRenderer.FrameHeight };
+			OctreeRenderer.OutputTextures[i] = clCreateImage(OctreeRenderer.Context, CL_MEM_WRITE_ONLY, &(cl_image_format){ CL_RGBA, CL_UNORM_INT8 }, &description, NULL, &error);
+			if (error < 0) { LogFatal("Failed to create output image: %i\n", error); }
+			continue;
+		}
+		OctreeRenderer.OutputTextures[i] = clCreateFromGLTexture(OctreeRenderer.Context, CL_MEM_WRITE_ONLY, GL_TEXTURE_2D, 0, OctreeRenderer.TextureIDs[i], &error);
+		if (error < 0) { LogFatal("Failed to create texture buffer: %i\n", error); }
+	}
+}
+
+static float EventTime(cl_event event)
+{
+	cl_ulong start, end;
+	clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(start), &start, NULL);
+	clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(end), &end, NULL);
+	return (end - start) / 1000000.0;
+}
+
+static cl_event * TrackEvent(ProfileStage stage)
+{
+	if (OctreeRenderer.Pipeline == RenderPipelineCPU || (!OctreeRenderer.CollectStatistics && OctreeRenderer.ProfileLog == NULL)) { return NULL; }
+	int index = OctreeRenderer.OutputIndex;
+	OctreeRenderer.PendingEvents[index] = ListPush(OctreeRenderer.PendingEvents[index], &(ProfileEvent){ stage, NULL });
+	return &OctreeRenderer.PendingEvents[index][ListCount(OctreeRenderer.PendingEvents[index]) - 1].Event;
+}
+
+static void RecordProfile(FrameProfile profile)
+{
+	OctreeRenderer.Profiles[OctreeRenderer.ProfileCount++ % ProfileWindow] = profile;
+	if (OctreeRenderer.ProfileLog == NULL) { return; }
+	char line[256];
+	float * t = profile.Stages;
+	int length = snprintf(line, sizeof(line), "%i,%.3f,%.3f,%i,%.3f,%.3f,%.3f,%.3f,%.3f\n", OctreeRenderer.ProfileCount, profile.GPUTime, profile.TickTime, profile.UploadBytes, t[0], t[1], t[2], t[3], t[4]);
+	SDL_RWwrite(OctreeRenderer.ProfileLog, line, length, 1);
+}
+
+FrameProfile OctreeRendererAverageProfile()
+{
+	FrameProfile average = { 0 };
+	int count = OctreeRenderer.ProfileCount < ProfileWindow ? OctreeRenderer.ProfileCount : ProfileWindow;
+	if (count == 0) { return average; }
+	for (int i = 0; i < count; i++)
+	{
+		FrameProfile * profile = &OctreeRenderer.Profiles[i];
+		average.GPUTime += profile->GPUTime / count;
+		average.TickTime += profile->TickTime / count;
+		average.UploadBytes += profile->UploadBytes;
+		for (int j = 0; j < ProfileStageCount; j++) { average.Stages[j] += profile->Stages[j] / count; }
+	}
+	average.UploadBytes /= count;
+	return average;
+}
+
+void OctreeRendererSetShadingCaches(bool enabled)
+{
+	if (enabled && !OctreeRenderer.ShadingCaches)
+	{
+		OctreeRenderer.SunRebuild = true;
+		OctreeRenderer.CloudTime = -INFINITY;
+	}
+	OctreeRenderer.ShadingCaches = enabled;
+	LogInfo("Sun and cloud caches %s\n", enabled ? "enabled" : "disabled, shading matches the CPU reference");
+}
+
+void OctreeRendererToggleProfileLog(const char * directory)
+{
+	if (OctreeRenderer.ProfileLog != NULL)
+	{
+		SDL_RWclose(OctreeRenderer.ProfileLog);
+		OctreeRenderer.ProfileLog = NULL;
+		LogInfo("Stopped writing frame profile\n");
+		return;
+	}
+	char path[1024];
+	snprintf(path, sizeof(path), "%sProfile.csv", directory);
+	OctreeRenderer.ProfileLog = SDL_RWFromFile(path, "w");
+	if (OctreeRenderer.ProfileLog == NULL)
+	{
+		LogWarning("Failed to write frame profile %s: %s\n", path, SDL_GetError());
+		return;
+	}
+	const char * header = "frame,gpu_ms,tick_ms,upload_bytes,upload_ms,acquire_ms,trace_ms,upscale_ms,release_ms\n";
+	SDL_RWwrite(OctreeRenderer.ProfileLog, header, strlen(header), 1);
+	LogInfo("Writing frame profile to %s\n", path);
+}
+
+static void FinishFrame(int index)
+{
+	if (OctreeRenderer.FrameEvents[index] == NULL) { return; }
+	clWaitForEvents(1, &OctreeRenderer.FrameEvents[index]);
+	cl_ulong start, end;
+	clGetEventProfilingInfo(OctreeRenderer.AcquireEvents[index], CL_PROFILING_COMMAND_START, sizeof(start), &start, NULL);
+	clGetEventProfilingInfo(OctreeRenderer.FrameEvents[index], CL_PROFILING_COMMAND_END, sizeof(end), &end, NULL);
+	OctreeRenderer.KernelTime = (end - start) / 1000000.0;
+	if (OctreeRenderer.CollectStatistics)
+	{
+		cl_uint * stats = OctreeRenderer.FrameStatistics[index];
+		OctreeRenderer.StepsPerRay = stats[RayStatisticRays] > 0 ? (float)stats[RayStatisticSteps] / stats[RayStatisticRays] : 0.0;
+		OctreeRenderer.RayCount = stats[RayStatisticRays];
+		memcpy(OctreeRenderer.Statistics, stats, sizeof(OctreeRenderer.Statistics));
+	}
+	FrameProfile profile = OctreeRenderer.PendingProfiles[index];
+	profile.GPUTime = OctreeRenderer.KernelTime;
+	profile.Stages[ProfileStageAcquire] = EventTime(OctreeRenderer.AcquireEvents[index]);
+	list(ProfileEvent) events = OctreeRenderer.PendingEvents[index];
+	for (int i = 0; i < ListCount(events); i++)
+	{
+		profile.Stages[events[i].Stage] += EventTime(events[i].Event);
+		clReleaseEvent(events[i].Event);
+	}
+	OctreeRenderer.PendingEvents[index] = ListClear(events);
+	RecordProfile(profile);
+	clReleaseEvent(OctreeRenderer.AcquireEvents[index]);
+	clReleaseEvent(OctreeRenderer.FrameEvents[index]);
+	OctreeRenderer.AcquireEvents[index] = NULL;
+	OctreeRenderer.FrameEvents[index] = NULL;
+}
+
+static void ReleaseOutputImages()
+{
+	if (OctreeRenderer.Context == NULL) { return; }
+	clFinish(OctreeRenderer.Queue);
+	FinishFrame(0);
+	FinishFrame(1);
+	clReleaseMemObject(OctreeRenderer.OutputTextures[0]);
+	clReleaseMemObject(OctreeRenderer.OutputTextures[1]);
+}
+
+static void CreateBandImage(SplitDevice * device, int rows)
+{
+	int error;
+	if (device->BandImage != NULL) { clReleaseMemObject(device->BandImage); }
+	cl_image_desc description = { .image_type = CL_MEM_OBJECT_IMAGE2D, .image_width = OctreeRenderer.Width, .image_height = rows };
+	device->BandImage = clCreateImage(OctreeRenderer.Context, CL_MEM_READ_WRITE, &(cl_image_format){ CL_RGBA, CL_UNORM_INT8 }, &description, NULL, &error);
+	if (error < 0) { LogFatal("Failed to create band image: %i\n", error); }
+	device->BandHeight = rows;
+}
+
+static void CreateRenderTarget()
+{
+	OctreeRenderer.Width = fmax(OctreeRenderer.FrameWidth * OctreeRenderer.RenderScale, 1.0);
+	OctreeRenderer.Height = fmax(OctreeRenderer.FrameHeight * OctreeRenderer.RenderScale, 1.0);
+	if (OctreeRenderer.Context == NULL) { return; }
+	int error;
+	cl_image_desc description = { .image_type = CL_MEM_OBJECT_IMAGE2D, .image_width = OctreeRenderer.Width, .image_height = OctreeRenderer.Height };
+	OctreeRenderer.RenderImage = clCreateImage(OctreeRenderer.Context, CL_MEM_READ_WRITE, &(cl_image_format){ CL_RGBA, CL_UNORM_INT8 }, &description, NULL, &error);
+	if (error < 0) { LogFatal("Failed to create render image: %i\n", error); }
+	for (int i = 0; i < 2; i++)
+	{
+		OctreeRenderer.HistoryImages[i] = clCreateImage(OctreeRenderer.Context, CL_MEM_READ_WRITE, &(cl_image_format){ CL_RGBA, CL_UNORM_INT8 }, &description, NULL, &error);
+		if (error < 0) { LogFatal("Failed to create history image: %i\n", error); }
+	}
+	for (int i = 1; i < ListCount(OctreeRenderer.SplitDevices); i++)
+	{
+		SplitDevice * device = &OctreeRenderer.SplitDevices[i];
+		CreateBandImage(device, fmin(ceil(OctreeRenderer.Height * (device->Share + SplitBandSlack)), OctreeRenderer.Height));
+	}
+	OctreeRenderer.CheckerboardHistory = false;
+	CreateScreenBuffers();
+	if (OctreeRenderer.Pipeline == RenderPipelineWavefront) { CreateWavefront(); }
+}
+
+static void ReleaseBandImages()
+{
+	for (int i = 1; i < ListCount(OctreeRenderer.SplitDevices); i++)
+	{
+		clFinish(OctreeRenderer.SplitDevices[i].Queue);
+		clReleaseMemObject(OctreeRenderer.SplitDevices[i].BandImage);
+		OctreeRenderer.SplitDevices[i].BandImage = NULL;
+	}
+}
+
+static void ReleaseRenderTarget()
+{
+	if (OctreeRenderer.Context == NULL) { return; }
+	ReleaseBandImages();
+	ReleaseWavefront();
+	ReleaseScreenBuffers();
+	clReleaseMemObject(OctreeRenderer.RenderImage);
+	clReleaseMemObject(OctreeRenderer.HistoryImages[0]);
+	clReleaseMemObject(OctreeRenderer.HistoryImages[1]);
+}
+
+static uint64_t HashBytes(uint64_t hash, const void * data, size_t size)
+{
+	for (size_t i = 0; i < size; i++) { hash = (hash ^ ((const unsigned char *)data)[i]) * 0x100000001b3; }
+	return hash;
+}
+
+static uint64_t ShaderKey(const char * source, size_t size, const char * options)
+{
+	char device[256] = { 0 }, driver[256] = { 0 };
+	clGetDeviceInfo(OctreeRenderer.Device, CL_DEVICE_NAME, sizeof(device) - 1, device, NULL);
+	clGetDeviceInfo(OctreeRenderer.Device, CL_DRIVER_VERSION, sizeof(driver) - 1, driver, NULL);
+	uint64_t hash = HashBytes(0xcbf29ce484222325, source, size);
+	hash = HashBytes(hash, options, strlen(options) + 1);
+	hash = HashBytes(hash, device, strlen(device) + 1);
+	return HashBytes(hash, driver, strlen(driver) + 1);
+}
+
+static cl_program LoadCachedShader(const char * path, uint64_t key, const char * options)
+{
+	SDL_RWops * file = SDL_RWFromFile(path, "rb");
+	if (file == NULL) { return NULL; }
+	uint64_t header[2] = { 0, 0 };
+	unsigned char * binary = NULL;
+	if (SDL_RWread(file, header, sizeof(header), 1) == 1 && header[0] == key && header[1] > 0)
+	{
+		binary = MemoryAllocate(header[1]);
+		if (SDL_RWread(file, binary, header[1], 1) != 1)
+		{
+			MemoryFree(binary);
+			binary = NULL;
+		}
+	}
+	SDL_RWclose(file);
+	if (binary == NULL) { return NULL; }
+	
+	int error, status;
+	size_t size = header[1];
+	cl_program program = clCreateProgramWithBinary(OctreeRenderer.Context, 1, &OctreeRenderer.Device, &size, (const unsigned char **)&binary, &status, &error);
+	MemoryFree(binary);
+	if (error < 0 || status < 0) { return NULL; }
+	if (clBuildProgram(program, 0, NULL, options, NULL, NULL) < 0)
+	{
+		clReleaseProgram(program);
+		return NULL;
+	}
+	return program;
+}
+
+static void SaveCachedShader(cl_program program, const char * path, uint64_t key)
+{
+	size_t size;
+	if (clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size), &size, NULL) < 0 || size == 0) { return; }
+	unsigned char * binary = MemoryAllocate(size);
+	if (clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(binary), &binary, NULL) >= 0)
+	{
+		SDL_RWops * file = SDL_RWFromFile(path, "wb");
+		if (file != NULL)
+		{
+			uint64_t header[2] = { key, size };
+			SDL_RWwrite(file, header, sizeof(header), 1);
+			SDL_RWwrite(file, binary, size, 1);
+			SDL_RWclose(file);
+		}
+		else { LogWarning("Failed to write shader cache %s: %s\n", path, SDL_GetError()); }
+	}
+	MemoryFree(binary);
+}
+
+static cl_program BuildShader(const char * source, size_t size, const char * options, const char * cacheDirectory, int * cached)
+{
+	uint64_t key = ShaderKey(source, size, options);
+	char path[1024] = { 0 };
+	cl_program program = NULL;
+	if (cacheDirectory != NULL)
+	{
+		snprintf(path, sizeof(path), "%sShader-%016llx.bin", cacheDirectory, (unsigned long long)key);
+		program = LoadCachedShader(path, key, options);
+	}
+	if (program != NULL)
+	{
+		(*cached)++;
+		return program;
+	}
+	
+	int error;
+	program = clCreateProgramWithSource(OctreeRenderer.Context, 1, &source, &size, &error);
+	if (error < 0) { LogFatal("Failed to create shader program: %i\n", error); }
+	error = clBuildProgram(program, 0, NULL, options, NULL, NULL);
+	if (error < 0)
+	{
+		size_t logSize;
+		clGetProgramBuildInfo(program, OctreeRenderer.Device, CL_PROGRAM_BUILD_LOG, 0, NULL, &logSize);
+		char * log = MemoryAllocate(logSize);
+		clGetProgramBuildInfo(program, OctreeRenderer.Device, CL_PROGRAM_BUILD_LOG, logSize, log, NULL);
+		LogFatal("Failed to compile shader program: %s\n", log);
+		MemoryFree(log);
+	}
+	if (cacheDirectory != NULL) { SaveCachedShader(program, path, key); }
+	return program;
+}
+
+static void LoadGroupSize()
+{
+	OctreeRenderer.GroupSize[0] = 8;
+	OctreeRenderer.GroupSize[1] = 8;
+	OctreeRenderer.GroupSizeTuning = true;
+	if (OctreeRenderer.GroupSizePath[0] == '\0') { return; }
+	SDL_RWops * file = SDL_RWFromFile(OctreeRenderer.GroupSizePath, "rb");
+	if (file == NULL) { return; }
+	uint64_t entry[3] = { 0, 0, 0 };
+	if (SDL_RWread(file, entry, sizeof(entry), 1) == 1 && entry[0] == OctreeRenderer.GroupSizeKey && entry[1] > 0 && entry[2] > 0)
+	{
+		OctreeRenderer.GroupSize[0] = entry[1];
+		OctreeRenderer.GroupSize[1] = entry[2];
+		OctreeRenderer.GroupSizeTuning = false;
+	}
+	SDL_RWclose(file);
+}
+
+static void SaveGroupSize()
+{
+	if (OctreeRenderer.GroupSizePath[0] == '\0') { return; }
+	SDL_RWops * file = SDL_RWFromFile(OctreeRenderer.GroupSizePath, "wb");
+	if (file == NULL)
+	{
+		LogWarning("Failed to write group size %s: %s\n", OctreeRenderer.GroupSizePath, SDL_GetError());
+		return;
+	}
+	uint64_t entry[3] = { OctreeRenderer.GroupSizeKey, OctreeRenderer.GroupSize[0], OctreeRenderer.GroupSize[1] };
+	SDL_RWwrite(file, entry, sizeof(entry), 1);
+	SDL_RWclose(file);
+}
+
+static double TimeGroupSize(cl_kernel kernel, size_t * localSize)
+{
+	int w = OctreeRenderer.Width, h = OctreeRenderer.Height;
+	size_t globalSize[] = { w + (localSize[0] - w % localSize[0]) % localSize[0], h + (localSize[1] - h % localSize[1]) % localSize[1] };
+	double best = INFINITY;
+	for (int i = 0; i <= GroupSizeRuns; i++)
+	{
+		cl_event event;
+		int error = clEnqueueNDRangeKernel(OctreeRenderer.Queue, kernel, 2, NULL, globalSize, localSize, 0, NULL, &event);
+		if (error < 0) { return INFINITY; }
+		clWaitForEvents(1, &event);
+		cl_ulong start, end;
+		clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(start), &start, NULL);
+		clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(end), &end, NULL);
+		clReleaseEvent(event);
+		if (i > 0) { best = fmin(best, (end - start) / 1000000.0); }
+	}
+	return best;
+}
+
+static void TuneGroupSize(cl_kernel kernel)
+{
+	size_t maxSize = 0, multiple = 1;
+	clGetKernelWorkGroupInfo(kernel, OctreeRenderer.Device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(maxSize), &maxSize, NULL);
+	clGetKernelWorkGroupInfo(kernel, OctreeRenderer.Device, CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE, sizeof(multiple), &multiple, NULL);
+	if (multiple == 0 || multiple > maxSize) { multiple = 1; }
+	
+	double best = INFINITY;
+	size_t bestSize[2] = { OctreeRenderer.GroupSize[0], OctreeRenderer.GroupSize[1] };
+	for (size_t x = 4; x <= 64; x *= 2)
+	{
+		for (size_t y = 1; y <= 16; y *= 2)
+		{
+			if (x * y > maxSize || (x * y) % multiple != 0) { continue; }
+			double time = TimeGroupSize(kernel, (size_t[]){ x, y });
+			if (time < best)
+			{
+				best = time;
+				bestSize[0] = x;
+				bestSize[1] = y;
+			}
+		}
+	}
+	OctreeRenderer.GroupSize[0] = bestSize[0];
+	OctreeRenderer.GroupSize[1] = bestSize[1];
+	OctreeRenderer.GroupSizeTuning = false;
+	LogInfo("Tuned trace group size to %zux%zu (%.2f ms, multiple %zu, max %zu)\n", bestSize[0], bestSize[1], best, multiple, maxSize);
+	SaveGroupSize();
+}
+
+static void KernelGroupSize(cl_kernel kernel, cl_device_id device, const size_t * preferred, size_t * groupSize)
+{
+	size_t maxSize = 0;
+	groupSize[0] = preferred[0];
+	groupSize[1] = preferred[1];
+	if (clGetKernelWorkGroupInfo(kernel, device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(maxSize), &maxSize, NULL) < 0 || maxSize == 0) { return; }
+	while (groupSize[0] * groupSize[1] > maxSize)
+	{
+		int i = groupSize[0] >= groupSize[1] ? 0 : 1;
+		groupSize[i] = groupSize[i] % 2 == 0 ? groupSize[i] / 2 : 1;
+	}
+}
+
+static cl_mem LoadTerrainImage()
+{
+	SDL_RWops * file = SDL_RWFromFile("Terrain.png", "rb");
+	if (file == NULL) { LogFatal("Failed to open Terrain.png: %s\n", SDL_GetError()); }
+	int fileSize = (int)SDL_RWseek(file, 0, RW_SEEK_END);
+	SDL_RWseek(file, 0, RW_SEEK_SET);
+	void * fileData = MemoryAllocate(fileSize);
+	SDL_RWread(file, fileData, fileSize, 1);
+	SDL_RWclose(file);
+	int width, height, channels;
+	unsigned char * pixels = stbi_load_from_memory(fileData, fileSize, &width, &height, &channels, 4);
+	if (pixels == NULL) { LogFatal("Failed to open Terrain.png: %s\n", stbi_failure_reason()); }
+	MemoryFree(fileData);
+	
+	int error;
+	cl_image_desc description = { .image_type = CL_MEM_OBJECT_IMAGE2D, .image_width = width, .image_height = height };
+	cl_mem image = clCreateImage(OctreeRenderer.Context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, &(cl_image_format){ CL_RGBA, CL_UNORM_INT8 }, &description, pixels, &error);
+	if (error < 0) { LogFatal("Failed to create terrain image: %i\n", error); }
+	stbi_image_free(pixels);
+	return image;
+}
+
+static int AcquireFrameObjects(int index)
+{
+	if (OctreeRenderer.Headless) { return clEnqueueMarkerWithWaitList(OctreeRenderer.Queue, 0, NULL, &OctreeRenderer.AcquireEvents[index]); }
+	return clEnqueueAcquireGLObjects(OctreeRenderer.Queue, 2, (cl_mem[]){ OctreeRenderer.OutputTexture, OctreeRenderer.TerrainTexture }, 0, NULL, &OctreeRenderer.AcquireEvents[index]);
+}
+
+static int ReleaseFrameObjects(cl_event * event)
+{
+	if (OctreeRenderer.Headless) { return clEnqueueMarkerWithWaitList(OctreeRenderer.Queue, 0, NULL, event); }
+	return clEnqueueReleaseGLObjects(OctreeRenderer.Queue, 2, (cl_mem[]){ OctreeRenderer.OutputTexture, OctreeRenderer.TerrainTexture }, 0, NULL, event);
+}
+
+void OctreeRendererTuneGroupSize()
+{
+	OctreeRenderer.GroupSizeTuning = true;
+	if (OctreeRenderer.Pipeline != RenderPipelineMegakernel) { LogInfo("Group size tuning will run once the megakernel pipeline is active\n"); }
+}
+
+void OctreeRendererInitialize(TextureManager textures, int width, int height, BlockStorage storage, const char * cacheDirectory)
+{
+	OctreeRenderer.FrameWidth = width;
+	OctreeRenderer.FrameHeight = height;
+	OctreeRenderer.RenderScale = 1.0;
+	OctreeRenderer.TargetFrameTime = 1000.0 / 60.0;
+	OctreeRenderer.TextureManager = textures;
+	OctreeRenderer.Storage = storage;
+	OctreeRenderer.FreeBricks = ListCreate(sizeof(int));
+	for (int i = 0; i < DirtyBufferCount; i++) { OctreeRenderer.DirtyRanges[i] = ListCreate(sizeof(DirtyRange)); }
+	OctreeRenderer.DirtyTiles = ListCreate(sizeof(int3));
+	for (int i = 0; i < 2; i++) { OctreeRenderer.PendingEvents[i] = ListCreate(sizeof(ProfileEvent)); }
+	OctreeRenderer.AsyncFrames = true;
+	OctreeRenderer.Headless = textures == NULL;
+	if (!OctreeRenderer.Headless)
+	{
+		OctreeRenderer.TerrainID = TextureManagerLoad(textures, "Terrain.png");
+		CreateOutputTextures();
+		CPURendererInitialize();
+	}
 	
 	cl_platform_id platform;
-	if (clGetPlatformIDs(1, &platform, NULL) < 0) { LogFatal("Couldn't find a suitable platform for OpenCL\n"); }
-	if (clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, 1, &OctreeRenderer.Device, NULL) == CL_DEVICE_NOT_FOUND) { LogFatal("No supported GPU found\n"); }
+	cl_device_id devices[SplitDeviceMax];
+	cl_uint deviceCount = 0;
+	cl_device_type deviceType = OctreeRenderer.Headless ? CL_DEVICE_TYPE_ALL : CL_DEVICE_TYPE_GPU;
+	if (clGetPlatformIDs(1, &platform, NULL) < 0 || clGetDeviceIDs(platform, deviceType, SplitDeviceMax, devices, &deviceCount) < 0 || deviceCount == 0)
+	{
+		if (OctreeRenderer.Headless) { LogFatal("No OpenCL device found\n"); }
+		LogWarning("No supported GPU found, falling back to the CPU renderer\n");
+		OctreeRenderer.Pipeline = RenderPipelineCPU;
+		CreateRenderTarget();
+		ResetDirtyRegion();
+		return;
+	}
+	deviceCount = deviceCount > SplitDeviceMax ? SplitDeviceMax : deviceCount;
+	OctreeRenderer.Device = devices[0];
 	
 	cl_context_properties properties[] =
 	{
@@ -42,10 +603,19 @@ void OctreeRendererInitialize(TextureManager textures, int width, int height)
 #endif
 		0,
 	};
+	cl_context_properties headlessProperties[] = { CL_CONTEXT_PLATFORM, (cl_context_properties)platform, 0 };
+	cl_context_properties * contextProperties = OctreeRenderer.Headless ? headlessProperties : properties;
 
 	int error;
-	OctreeRenderer.Context = clCreateContext(properties, 1, &OctreeRenderer.Device, NULL, NULL, &error);
+	OctreeRenderer.Context = clCreateContext(contextProperties, deviceCount, devices, NULL, NULL, &error);
+	if (error < 0 && deviceCount > 1)
+	{
+		LogWarning("Failed to share a context between %u devices: %i\n", deviceCount, error);
+		deviceCount = 1;
+		OctreeRenderer.Context = clCreateContext(contextProperties, 1, &OctreeRenderer.Device, NULL, NULL, &error);
+	}
 	if (error < 0) { LogFatal("Failed to create context: %i\n", error); }
+	const char * shaderCache = deviceCount == 1 ? cacheDirectory : NULL;
 	
 	SDL_RWops * shaderFile = SDL_RWFromFile("Shaders/Raytracer.cl", "r");
 	if (shaderFile == NULL) { LogFatal("Failed to open Raytracer.cl: %s\n", SDL_GetError()); }
@@ -55,81 +625,992 @@ void OctreeRendererInitialize(TextureManager textures, int width, int height)
 	SDL_RWread(shaderFile, shaderText, fileSize, 1);
 	SDL_RWclose(shaderFile);
 	shaderText[fileSize] = '\0';
-	OctreeRenderer.Shader = clCreateProgramWithSource(OctreeRenderer.Context, 1, (const char **)&shaderText, &fileSize, &error);
-	if (error < 0) { LogFatal("Failed to create shader program: %i\n", error); }
+	uint64_t buildStart = TimeNano();
+	int cached = 0;
+	OctreeRenderer.Shader = BuildShader(shaderText, fileSize, ShaderFeatures, shaderCache, &cached);
+	for (int i = 0; i < TraceVariantCount; i++) { OctreeRenderer.TraceShaders[i] = BuildShader(shaderText, fileSize, TraceVariantOptions[i], shaderCache, &cached); }
+	OctreeRenderer.GroupSizeKey = ShaderKey(shaderText, fileSize, TraceVariantOptions[TraceVariantAboveWater]);
+	OctreeRenderer.GroupSizePath[0] = '\0';
+	if (cacheDirectory != NULL) { snprintf(OctreeRenderer.GroupSizePath, sizeof(OctreeRenderer.GroupSizePath), "%sGroupSize-%016llx.bin", cacheDirectory, (unsigned long long)OctreeRenderer.GroupSizeKey); }
+	LoadGroupSize();
 	MemoryFree(shaderText);
+	LogInfo("Built shaders in %.1f ms (%s start, %i of %i from cache)\n", (TimeNano() - buildStart) / 1000000.0, cached == 1 + TraceVariantCount ? "warm" : "cold", cached, 1 + TraceVariantCount);
 	
-	error = clBuildProgram(OctreeRenderer.Shader, 0, NULL, NULL, NULL, NULL);
-	if (error < 0)
+	char extensions[4096] = { 0 };
+	clGetDeviceInfo(OctreeRenderer.Device, CL_DEVICE_EXTENSIONS, sizeof(extensions) - 1, extensions, NULL);
+	OctreeRenderer.GLEvents = strstr(extensions, "cl_khr_gl_event") != NULL;
+	OctreeRenderer.Queue = clCreateCommandQueue(OctreeRenderer.Context, OctreeRenderer.Device, CL_QUEUE_PROFILING_ENABLE, &error);
+	if (error < 0) { LogFatal("Failed to create command queue: %i\n", error); }
+	for (int i = 0; i < TraceVariantCount; i++)
 	{
-		size_t logSize;
-		clGetProgramBuildInfo(OctreeRenderer.Shader, OctreeRenderer.Device, CL_PROGRAM_BUILD_LOG, 0, NULL, &logSize);
-		char * log = MemoryAllocate(logSize);
-		clGetProgramBuildInfo(OctreeRenderer.Shader, OctreeRenderer.Device, CL_PROGRAM_BUILD_LOG, logSize, log, NULL);
-		LogFatal("Failed to compile shader program: %s\n", log);
-		MemoryFree(log);
+		OctreeRenderer.Kernels[i] = clCreateKernel(OctreeRenderer.TraceShaders[i], "trace", &error);
+		if (error < 0) { LogFatal("Failed to create kernel: %i\n", error); }
+		OctreeRenderer.PersistentKernels[i] = clCreateKernel(OctreeRenderer.TraceShaders[i], "tracePersistent", &error);
+		if (error < 0) { LogFatal("Failed to create kernel: %i\n", error); }
 	}
-	
-	OctreeRenderer.Queue = clCreateCommandQueue(OctreeRenderer.Context, OctreeRenderer.Device, 0, &error);
-	if (error < 0) { LogFatal("Failed to create command queue: %i\n", error); }
-	OctreeRenderer.Kernel = clCreateKernel(OctreeRenderer.Shader, "trace", &error);
+	cl_uint computeUnits = 1;
+	size_t maxGroupSize = PersistentTileSize * PersistentTileSize;
+	clGetDeviceInfo(OctreeRenderer.Device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(computeUnits), &computeUnits, NULL);
+	clGetKernelWorkGroupInfo(OctreeRenderer.PersistentKernels[0], OctreeRenderer.Device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(maxGroupSize), &maxGroupSize, NULL);
+	OctreeRenderer.PersistentLocalSize = maxGroupSize < PersistentTileSize * PersistentTileSize ? maxGroupSize : PersistentTileSize * PersistentTileSize;
+	OctreeRenderer.PersistentGlobalSize = computeUnits * PersistentGroupsPerUnit * OctreeRenderer.PersistentLocalSize;
+	OctreeRenderer.SplitDevices = ListCreate(sizeof(SplitDevice));
+	for (int i = 0; i < deviceCount; i++)
+	{
+		SplitDevice device = { .Device = devices[i], .Queue = OctreeRenderer.Queue, .Share = 1.0 / deviceCount };
+		for (int j = 0; j < TraceVariantCount; j++) { device.Kernels[j] = OctreeRenderer.Kernels[j]; }
+		if (i > 0)
+		{
+			device.Queue = clCreateCommandQueue(OctreeRenderer.Context, devices[i], CL_QUEUE_PROFILING_ENABLE, &error);
+			if (error < 0) { LogFatal("Failed to create command queue: %i\n", error); }
+			for (int j = 0; j < TraceVariantCount; j++)
+			{
+				device.Kernels[j] = clCreateKernel(OctreeRenderer.TraceShaders[j], "trace", &error);
+				if (error < 0) { LogFatal("Failed to create kernel: %i\n", error); }
+			}
+		}
+		OctreeRenderer.SplitDevices = ListPush(OctreeRenderer.SplitDevices, &device);
+	}
+	if (deviceCount > 1) { LogInfo("Splitting frames across %u devices\n", deviceCount); }
+	OctreeRenderer.DistanceKernel = clCreateKernel(OctreeRenderer.Shader, "distanceField", &error);
+	if (error < 0) { LogFatal("Failed to create kernel: %i\n", error); }
+	for (int i = 0; i < WavefrontStageCount; i++)
+	{
+		OctreeRenderer.WavefrontKernels[i] = clCreateKernel(OctreeRenderer.Shader, WavefrontKernelNames[i], &error);
+		if (error < 0) { LogFatal("Failed to create kernel: %i\n", error); }
+	}
+	OctreeRenderer.BeamKernel = clCreateKernel(OctreeRenderer.Shader, "beam", &error);
+	if (error < 0) { LogFatal("Failed to create kernel: %i\n", error); }
+	OctreeRenderer.ReprojectKernel = clCreateKernel(OctreeRenderer.Shader, "reproject", &error);
+	if (error < 0) { LogFatal("Failed to create kernel: %i\n", error); }
+	OctreeRenderer.UpscaleKernel = clCreateKernel(OctreeRenderer.Shader, "upscale", &error);
+	if (error < 0) { LogFatal("Failed to create kernel: %i\n", error); }
+	OctreeRenderer.ReconstructKernel = clCreateKernel(OctreeRenderer.Shader, "reconstruct", &error);
+	if (error < 0) { LogFatal("Failed to create kernel: %i\n", error); }
+	OctreeRenderer.SunKernel = clCreateKernel(OctreeRenderer.Shader, "sunVisibility", &error);
+	if (error < 0) { LogFatal("Failed to create kernel: %i\n", error); }
+	OctreeRenderer.CloudKernel = clCreateKernel(OctreeRenderer.Shader, "cloudLayer", &error);
+	if (error < 0) { LogFatal("Failed to create kernel: %i\n", error); }
+	OctreeRenderer.HeatmapKernel = clCreateKernel(OctreeRenderer.Shader, "heatmap", &error);
 	if (error < 0) { LogFatal("Failed to create kernel: %i\n", error); }
 	
-	OctreeRenderer.OutputTexture = clCreateFromGLTexture(OctreeRenderer.Context, CL_MEM_WRITE_ONLY, GL_TEXTURE_2D, 0, OctreeRenderer.TextureID, &error);
-	if (error < 0) { LogFatal("Failed to create texture buffer: %i\n", error); }
-	error = clSetKernelArg(OctreeRenderer.Kernel, 3, sizeof(cl_mem), &OctreeRenderer.OutputTexture);
-	error |= clSetKernelArg(OctreeRenderer.Kernel, 4, sizeof(int), &OctreeRenderer.Width);
-	error |= clSetKernelArg(OctreeRenderer.Kernel, 5, sizeof(int), &OctreeRenderer.Height);
-	if (error < 0) { LogFatal("Failed to set kernel arguments: %i\n", error); }
+	CreateOutputImages();
 	
-	OctreeRenderer.TerrainTexture = clCreateFromGLTexture(OctreeRenderer.Context, CL_MEM_READ_ONLY, GL_TEXTURE_2D, 0, TextureManagerLoad(textures, "Terrain.png"), &error);
-	if (error < 0) { LogFatal("Failed to create texture buffer: %i\n", error); }
-	error = clSetKernelArg(OctreeRenderer.Kernel, 7, sizeof(cl_mem), &OctreeRenderer.TerrainTexture);
-	if (error < 0) { LogFatal("Failed to set kernel arguments: %i\n", error); }
+	if (OctreeRenderer.Headless) { OctreeRenderer.TerrainTexture = LoadTerrainImage(); }
+	else
+	{
+		OctreeRenderer.TerrainTexture = clCreateFromGLTexture(OctreeRenderer.Context, CL_MEM_READ_ONLY, GL_TEXTURE_2D, 0, OctreeRenderer.TerrainID, &error);
+		if (error < 0) { LogFatal("Failed to create texture buffer: %i\n", error); }
+	}
+	if (deviceCount > 1)
+	{
+		cl_image_format format;
+		cl_image_desc description = { .image_type = CL_MEM_OBJECT_IMAGE2D };
+		clGetImageInfo(OctreeRenderer.TerrainTexture, CL_IMAGE_FORMAT, sizeof(format), &format, NULL);
+		clGetImageInfo(OctreeRenderer.TerrainTexture, CL_IMAGE_WIDTH, sizeof(size_t), &description.image_width, NULL);
+		clGetImageInfo(OctreeRenderer.TerrainTexture, CL_IMAGE_HEIGHT, sizeof(size_t), &description.image_height, NULL);
+		OctreeRenderer.TerrainCopy = clCreateImage(OctreeRenderer.Context, CL_MEM_READ_ONLY, &format, &description, NULL, &error);
+		if (error < 0) { LogFatal("Failed to create terrain copy: %i\n", error); }
+		OctreeRenderer.TerrainDirty = true;
+	}
+	
+	OctreeRenderer.StatisticsBuffer = clCreateBuffer(OctreeRenderer.Context, CL_MEM_READ_WRITE, RayStatisticCount * sizeof(cl_uint), NULL, &error);
+	if (error < 0) { LogFatal("Failed to create statistics buffer: %i\n", error); }
+	OctreeRenderer.MaterialBuffer = clCreateBuffer(OctreeRenderer.Context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(Blocks.Materials), Blocks.Materials, &error);
+	if (error < 0) { LogFatal("Failed to create material buffer: %i\n", error); }
+	OctreeRenderer.TileCounter = clCreateBuffer(OctreeRenderer.Context, CL_MEM_READ_WRITE, sizeof(cl_uint), NULL, &error);
+	if (error < 0) { LogFatal("Failed to create tile counter: %i\n", error); }
+	OctreeRenderer.CloudBuffer = clCreateBuffer(OctreeRenderer.Context, CL_MEM_READ_WRITE, (4 + CloudLayerSize * CloudLayerSize) * sizeof(cl_float), NULL, &error);
+	if (error < 0) { LogFatal("Failed to create cloud buffer: %i\n", error); }
+	OctreeRenderer.CloudTime = -INFINITY;
+	CreateRenderTarget();
+	ResetDirtyRegion();
+	OctreeRenderer.BeamPrepass = true;
+	OctreeRenderer.TemporalReprojection = true;
+	OctreeRenderer.ShadingCaches = true;
 }
 
 void OctreeRendererResize(int width, int height)
 {
-	clReleaseMemObject(OctreeRenderer.OutputTexture);
-	glDeleteTextures(1, &OctreeRenderer.TextureID);
-	OctreeRenderer.Width = width;
-	OctreeRenderer.Height = height;
-	glGenTextures(1, &OctreeRenderer.TextureID);
-	glBindTexture(GL_TEXTURE_2D, OctreeRenderer.TextureID);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	ReleaseRenderTarget();
+	ReleaseOutputImages();
+	if (!OctreeRenderer.Headless) { glDeleteTextures(2, OctreeRenderer.TextureIDs); }
+	OctreeRenderer.FrameWidth = width;
+	OctreeRenderer.FrameHeight = height;
+	CreateOutputTextures();
+	CreateOutputImages();
+	CreateRenderTarget();
+}
+
+static void SetRenderScale(float scale)
+{
+	if (scale == OctreeRenderer.RenderScale) { return; }
+	ReleaseRenderTarget();
+	OctreeRenderer.RenderScale = scale;
+	CreateRenderTarget();
+	OctreeRenderer.ScaleCooldown = 30;
+}
+
+static void UpdateRenderScale()
+{
+	uint64_t now = TimeNano();
+	float frameTime = OctreeRenderer.LastFrame == 0 ? OctreeRenderer.TargetFrameTime : (now - OctreeRenderer.LastFrame) / 1000000.0;
+	OctreeRenderer.LastFrame = now;
+	OctreeRenderer.FrameTime += (frameTime - OctreeRenderer.FrameTime) * 0.1;
+	if (!OctreeRenderer.DynamicResolution || OctreeRenderer.ScaleCooldown-- > 0) { return; }
+	
+	float ideal = OctreeRenderer.RenderScale * sqrt(OctreeRenderer.TargetFrameTime / OctreeRenderer.FrameTime);
+	ideal = fmin(fmax(ideal, RenderScaleMin), 1.0);
+	float scale = round(ideal / RenderScaleStep) * RenderScaleStep;
+	SetRenderScale(scale);
+}
+
+void OctreeRendererSetDynamicResolution(bool enabled)
+{
+	OctreeRenderer.DynamicResolution = enabled;
+	OctreeRenderer.FrameTime = OctreeRenderer.TargetFrameTime;
+	if (!enabled) { SetRenderScale(1.0); }
+}
+
+static int3 ClampToLevel(int3 v, int3 max)
+{
+	return (int3){ v.x < 0 ? 0 : (v.x > max.x ? max.x : v.x), v.y < 0 ? 0 : (v.y > max.y ? max.y : v.y), v.z < 0 ? 0 : (v.z > max.z ? max.z : v.z) };
+}
+
+static cl_int4 Int4(int3 v)
+{
+	return (cl_int4){ .s = { v.x, v.y, v.z, 0 } };
+}
+
+static void EnqueueDistancePass(cl_mem src, int3 srcMin, int3 srcMax, cl_mem dst, int3 dstMin, int3 dstMax, int3 regionMin, int3 regionMax, int axis)
+{
+	cl_kernel kernel = OctreeRenderer.DistanceKernel;
+	cl_int4 bounds[] = { Int4(srcMin), Int4(srcMax - srcMin), Int4(dstMin), Int4(dstMax - dstMin) };
+	int error = clSetKernelArg(kernel, 0, sizeof(unsigned int), &OctreeRenderer.Octree->Depth);
+	error |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &OctreeRenderer.BlockBuffer);
+	error |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &OctreeRenderer.BrickBuffer);
+	error |= clSetKernelArg(kernel, 3, sizeof(cl_mem), &OctreeRenderer.BrickPoolBuffer);
+	error |= clSetKernelArg(kernel, 4, sizeof(int), &(int){ OctreeRenderer.Storage });
+	error |= clSetKernelArg(kernel, 5, sizeof(cl_mem), &src);
+	error |= clSetKernelArg(kernel, 6, sizeof(cl_int4), &bounds[0]);
+	error |= clSetKernelArg(kernel, 7, sizeof(cl_int4), &bounds[1]);
+	error |= clSetKernelArg(kernel, 8, sizeof(cl_mem), &dst);
+	error |= clSetKernelArg(kernel, 9, sizeof(cl_int4), &bounds[2]);
+	error |= clSetKernelArg(kernel, 10, sizeof(cl_int4), &bounds[3]);
+	error |= clSetKernelArg(kernel, 11, sizeof(int), &axis);
+	if (error < 0) { LogFatal("Failed to set distance field arguments: %i\n", error); }
+	int3 size = regionMax - regionMin;
+	error = clEnqueueNDRangeKernel(OctreeRenderer.Queue, kernel, 3, (size_t[]){ regionMin.x, regionMin.y, regionMin.z }, (size_t[]){ size.x, size.y, size.z }, NULL, 0, NULL, NULL);
+	if (error < 0) { LogFatal("Failed to enqueue distance field pass: %i\n", error); }
+}
+
+static void ReleaseDistanceField()
+{
+	if (OctreeRenderer.DistanceBuffer == NULL) { return; }
+	clFinish(OctreeRenderer.Queue);
+	clReleaseMemObject(OctreeRenderer.DistanceBuffer);
+	clReleaseMemObject(OctreeRenderer.DistanceScratchBuffer);
+	clReleaseMemObject(OctreeRenderer.DistanceRepairBuffers[0]);
+	clReleaseMemObject(OctreeRenderer.DistanceRepairBuffers[1]);
+	OctreeRenderer.DistanceBuffer = NULL;
+}
+
+static void BuildDistanceField()
+{
+	Level level = OctreeRenderer.Octree->Level;
+	int3 levelMax = { level->Width, level->Depth, level->Height };
+	int repairSize = (2 * DistanceFieldMax + 1) * (4 * DistanceFieldMax + 1) * (4 * DistanceFieldMax + 1);
 	int error;
-	OctreeRenderer.OutputTexture = clCreateFromGLTexture(OctreeRenderer.Context, CL_MEM_WRITE_ONLY, GL_TEXTURE_2D, 0, OctreeRenderer.TextureID, &error);
-	if (error < 0) { LogFatal("Failed to create texture buffer: %i\n", error); }
-	error = clSetKernelArg(OctreeRenderer.Kernel, 3, sizeof(cl_mem), &OctreeRenderer.OutputTexture);
-	error |= clSetKernelArg(OctreeRenderer.Kernel, 4, sizeof(int), &OctreeRenderer.Width);
-	error |= clSetKernelArg(OctreeRenderer.Kernel, 5, sizeof(int), &OctreeRenderer.Height);
-	if (error < 0) { LogFatal("Failed to set kernel arguments: %i\n", error); }
+	OctreeRenderer.DistanceBuffer = clCreateBuffer(OctreeRenderer.Context, CL_MEM_READ_WRITE, level->Width * level->Height * level->Depth, NULL, &error);
+	if (error < 0) { LogFatal("Failed to create distance buffer: %i\n", error); }
+	OctreeRenderer.DistanceScratchBuffer = clCreateBuffer(OctreeRenderer.Context, CL_MEM_READ_WRITE, level->Width * level->Height * level->Depth, NULL, &error);
+	if (error < 0) { LogFatal("Failed to create distance buffer: %i\n", error); }
+	for (int i = 0; i < 2; i++)
+	{
+		OctreeRenderer.DistanceRepairBuffers[i] = clCreateBuffer(OctreeRenderer.Context, CL_MEM_READ_WRITE, repairSize, NULL, &error);
+		if (error < 0) { LogFatal("Failed to create distance buffer: %i\n", error); }
+	}
+	
+	int3 zero = { 0, 0, 0 };
+	EnqueueDistancePass(OctreeRenderer.DistanceScratchBuffer, zero, levelMax, OctreeRenderer.DistanceBuffer, zero, levelMax, zero, levelMax, 0);
+	EnqueueDistancePass(OctreeRenderer.DistanceBuffer, zero, levelMax, OctreeRenderer.DistanceScratchBuffer, zero, levelMax, zero, levelMax, 1);
+	EnqueueDistancePass(OctreeRenderer.DistanceScratchBuffer, zero, levelMax, OctreeRenderer.DistanceBuffer, zero, levelMax, zero, levelMax, 2);
+}
+
+static void RepairDistanceField(int x, int y, int z)
+{
+	Level level = OctreeRenderer.Octree->Level;
+	int3 levelMax = { level->Width, level->Depth, level->Height };
+	int3 p = { x, y, z };
+	int m = DistanceFieldMax;
+	int3 xMin = ClampToLevel(p - (int3){ m, 2 * m, 2 * m }, levelMax), xMax = ClampToLevel(p + (int3){ m, 2 * m, 2 * m } + 1, levelMax);
+	int3 yMin = ClampToLevel(p - (int3){ m, m, 2 * m }, levelMax), yMax = ClampToLevel(p + (int3){ m, m, 2 * m } + 1, levelMax);
+	int3 zMin = ClampToLevel(p - m, levelMax), zMax = ClampToLevel(p + m + 1, levelMax);
+	cl_mem * repair = OctreeRenderer.DistanceRepairBuffers;
+	EnqueueDistancePass(repair[1], xMin, xMax, repair[0], xMin, xMax, xMin, xMax, 0);
+	EnqueueDistancePass(repair[0], xMin, xMax, repair[1], yMin, yMax, yMin, yMax, 1);
+	EnqueueDistancePass(repair[1], yMin, yMax, OctreeRenderer.DistanceBuffer, (int3){ 0, 0, 0 }, levelMax, zMin, zMax, 2);
+}
+
+void OctreeRendererMarkDirty(DirtyBuffer buffer, int start, int size)
+{
+	list(DirtyRange) ranges = OctreeRenderer.DirtyRanges[buffer];
+	int count = ListCount(ranges);
+	if (count > 0 && start <= ranges[count - 1].End + DirtyRangeGap && start + size >= ranges[count - 1].Start - DirtyRangeGap)
+	{
+		ranges[count - 1].Start = start < ranges[count - 1].Start ? start : ranges[count - 1].Start;
+		ranges[count - 1].End = start + size > ranges[count - 1].End ? start + size : ranges[count - 1].End;
+		return;
+	}
+	OctreeRenderer.DirtyRanges[buffer] = ListPush(ranges, &(DirtyRange){ start, start + size });
+}
+
+static int CompareDirtyRanges(const void * a, const void * b)
+{
+	return ((const DirtyRange *)a)->Start - ((const DirtyRange *)b)->Start;
+}
+
+static unsigned char * DirtyBufferSource(DirtyBuffer buffer, cl_mem * target)
+{
+	Level level = OctreeRenderer.Octree->Level;
+	switch (buffer)
+	{
+		case DirtyBufferOctree: *target = OctreeRenderer.OctreeBuffer; return OctreeRenderer.Octree->Masks;
+		case DirtyBufferBlocks: *target = OctreeRenderer.BlockBuffer; return OctreeRenderer.Storage == BlockStorageMorton ? OctreeRenderer.BlockMirror : level->Blocks;
+		case DirtyBufferBricks: *target = OctreeRenderer.BrickBuffer; return (unsigned char *)OctreeRenderer.Bricks;
+		case DirtyBufferBrickPool: *target = OctreeRenderer.BrickPoolBuffer; return OctreeRenderer.BrickPool;
+		case DirtyBufferHeights: *target = OctreeRenderer.HeightBuffer; return OctreeRenderer.ColumnHeights;
+		default: return NULL;
+	}
+}
+
+static void FlushDirtyRanges()
+{
+	for (int i = 0; i < DirtyBufferCount; i++)
+	{
+		list(DirtyRange) ranges = OctreeRenderer.DirtyRanges[i];
+		int count = ListCount(ranges);
+		if (count == 0) { continue; }
+		cl_mem target;
+		unsigned char * source = DirtyBufferSource(i, &target);
+		qsort(ranges, count, sizeof(DirtyRange), CompareDirtyRanges);
+		DirtyRange range = ranges[0];
+		for (int j = 1; j <= count; j++)
+		{
+			if (j < count && ranges[j].Start <= range.End + DirtyRangeGap)
+			{
+				range.End = ranges[j].End > range.End ? ranges[j].End : range.End;
+				continue;
+			}
+			int error = clEnqueueWriteBuffer(OctreeRenderer.Queue, target, false, range.Start, range.End - range.Start, source + range.Start, 0, NULL, TrackEvent(ProfileStageUpload));
+			if (error < 0) { LogFatal("Failed to write buffer: %i\n", error); }
+			OctreeRenderer.PendingProfiles[OctreeRenderer.OutputIndex].UploadBytes += range.End - range.Start;
+			if (j < count) { range = ranges[j]; }
+		}
+		OctreeRenderer.DirtyRanges[i] = ListClear(ranges);
+	}
+	
+	if (OctreeRenderer.DistanceBuffer != NULL)
+	{
+		for (int i = 0; i < ListCount(OctreeRenderer.DirtyTiles); i++) { RepairDistanceField(OctreeRenderer.DirtyTiles[i].x, OctreeRenderer.DirtyTiles[i].y, OctreeRenderer.DirtyTiles[i].z); }
+	}
+	OctreeRenderer.DirtyTiles = ListClear(OctreeRenderer.DirtyTiles);
+}
+
+static void ClearDirtyRanges()
+{
+	for (int i = 0; i < DirtyBufferCount; i++) { OctreeRenderer.DirtyRanges[i] = ListClear(OctreeRenderer.DirtyRanges[i]); }
+	OctreeRenderer.DirtyTiles = ListClear(OctreeRenderer.DirtyTiles);
+}
+
+static unsigned int MortonSpread(unsigned int v)
+{
+	v = (v | (v << 8)) & 0x0300f00f;
+	v = (v | (v << 4)) & 0x030c30c3;
+	return (v | (v << 2)) & 0x09249249;
+}
+
+static int BlockIndex(Level level, int x, int y, int z)
+{
+	if (OctreeRenderer.Storage != BlockStorageMorton) { return (y * level->Height + z) * level->Width + x; }
+	unsigned int local = MortonSpread(x & 63) | (MortonSpread(y) << 1) | (MortonSpread(z & 63) << 2);
+	return (((z >> 6) * (level->Width >> 6) + (x >> 6)) << 18) | local;
+}
+
+static unsigned int ReadBrick(Level level, int3 brick, unsigned char * payload)
+{
+	bool uniform = true;
+	for (int y = 0; y < 8; y++)
+	{
+		for (int z = 0; z < 8; z++)
+		{
+			for (int x = 0; x < 8; x++)
+			{
+				unsigned char tile = level->Blocks[((brick.y * 8 + y) * level->Height + brick.z * 8 + z) * level->Width + brick.x * 8 + x];
+				payload[(y << 6) | (z << 3) | x] = tile;
+				uniform &= tile == payload[0];
+			}
+		}
+	}
+	return uniform ? BrickUniform | payload[0] : 0;
+}
+
+static void ReleaseBrickmap()
+{
+	if (OctreeRenderer.BrickBuffer != NULL) { clReleaseMemObject(OctreeRenderer.BrickBuffer); }
+	if (OctreeRenderer.BrickPoolBuffer != NULL) { clReleaseMemObject(OctreeRenderer.BrickPoolBuffer); }
+	if (OctreeRenderer.Bricks != NULL) { MemoryFree(OctreeRenderer.Bricks); }
+	if (OctreeRenderer.BrickPool != NULL) { MemoryFree(OctreeRenderer.BrickPool); }
+	OctreeRenderer.BrickBuffer = NULL;
+	OctreeRenderer.BrickPoolBuffer = NULL;
+	OctreeRenderer.Bricks = NULL;
+	OctreeRenderer.BrickPool = NULL;
+	OctreeRenderer.FreeBricks = ListClear(OctreeRenderer.FreeBricks);
+	OctreeRenderer.BrickCount = 0;
+	OctreeRenderer.BrickCapacity = 0;
+}
+
+static void CreateBrickmap(Level level)
+{
+	int3 bricks = { level->Width / 8, level->Depth / 8, level->Height / 8 };
+	int brickCount = bricks.x * bricks.y * bricks.z;
+	OctreeRenderer.Bricks = MemoryAllocate(brickCount * sizeof(unsigned int));
+	unsigned char * pool = MemoryAllocate(brickCount * 512);
+	for (int y = 0; y < bricks.y; y++)
+	{
+		for (int z = 0; z < bricks.z; z++)
+		{
+			for (int x = 0; x < bricks.x; x++)
+			{
+				unsigned char * payload = pool + OctreeRenderer.BrickCount * 512;
+				unsigned int entry = ReadBrick(level, (int3){ x, y, z }, payload);
+				if (entry == 0) { entry = OctreeRenderer.BrickCount++; }
+				OctreeRenderer.Bricks[(y * bricks.z + z) * bricks.x + x] = entry;
+			}
+		}
+	}
+	
+	int error;
+	OctreeRenderer.BrickCapacity = OctreeRenderer.BrickCount + OctreeRenderer.BrickCount / 2 + 64;
+	OctreeRenderer.BrickPool = MemoryAllocate(OctreeRenderer.BrickCapacity * 512);
+	memcpy(OctreeRenderer.BrickPool, pool, OctreeRenderer.BrickCount * 512);
+	OctreeRenderer.BrickBuffer = clCreateBuffer(OctreeRenderer.Context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, brickCount * sizeof(unsigned int), OctreeRenderer.Bricks, &error);
+	if (error < 0) { LogFatal("Failed to create brick buffer: %i\n", error); }
+	OctreeRenderer.BrickPoolBuffer = clCreateBuffer(OctreeRenderer.Context, CL_MEM_READ_ONLY, OctreeRenderer.BrickCapacity * 512, NULL, &error);
+	if (error < 0) { LogFatal("Failed to create brick pool: %i\n", error); }
+	if (OctreeRenderer.BrickCount > 0)
+	{
+		error = clEnqueueWriteBuffer(OctreeRenderer.Queue, OctreeRenderer.BrickPoolBuffer, true, 0, OctreeRenderer.BrickCount * 512, OctreeRenderer.BrickPool, 0, NULL, NULL);
+		if (error < 0) { LogFatal("Failed to write brick pool: %i\n", error); }
+	}
+	MemoryFree(pool);
+	LogInfo("Brickmap uses %i of %i bricks (%i KB, dense %i KB)\n", OctreeRenderer.BrickCount, brickCount, (brickCount * 4 + OctreeRenderer.BrickCapacity * 512) / 1024, brickCount * 512 / 1024);
+}
+
+static int AllocateBrick()
+{
+	int count = ListCount(OctreeRenderer.FreeBricks);
+	if (count > 0)
+	{
+		int index = OctreeRenderer.FreeBricks[count - 1];
+		OctreeRenderer.FreeBricks = ListPop(OctreeRenderer.FreeBricks);
+		return index;
+	}
+	if (OctreeRenderer.BrickCount == OctreeRenderer.BrickCapacity)
+	{
+		int error;
+		int capacity = OctreeRenderer.BrickCapacity * 2;
+		cl_mem pool = clCreateBuffer(OctreeRenderer.Context, CL_MEM_READ_ONLY, capacity * 512, NULL, &error);
+		if (error < 0) { LogFatal("Failed to grow brick pool: %i\n", error); }
+		error = clEnqueueCopyBuffer(OctreeRenderer.Queue, OctreeRenderer.BrickPoolBuffer, pool, 0, 0, OctreeRenderer.BrickCapacity * 512, 0, NULL, NULL);
+		if (error < 0) { LogFatal("Failed to grow brick pool: %i\n", error); }
+		clFinish(OctreeRenderer.Queue);
+		clReleaseMemObject(OctreeRenderer.BrickPoolBuffer);
+		OctreeRenderer.BrickPoolBuffer = pool;
+		unsigned char * mirror = MemoryAllocate(capacity * 512);
+		memcpy(mirror, OctreeRenderer.BrickPool, OctreeRenderer.BrickCapacity * 512);
+		MemoryFree(OctreeRenderer.BrickPool);
+		OctreeRenderer.BrickPool = mirror;
+		OctreeRenderer.BrickCapacity = capacity;
+	}
+	return OctreeRenderer.BrickCount++;
+}
+
+static void UpdateBrick(Level level, int x, int y, int z, BlockType tile)
+{
+	int3 brick = { x / 8, y / 8, z / 8 };
+	int index = (brick.y * (level->Height / 8) + brick.z) * (level->Width / 8) + brick.x;
+	unsigned int entry = OctreeRenderer.Bricks[index];
+	unsigned char payload[512];
+	unsigned int uniform = ReadBrick(level, brick, payload);
+	if (entry & BrickUniform)
+	{
+		if (uniform != 0) { entry = uniform; }
+		else
+		{
+			entry = AllocateBrick();
+			memcpy(OctreeRenderer.BrickPool + entry * 512, payload, 512);
+			OctreeRendererMarkDirty(DirtyBufferBrickPool, entry * 512, 512);
+		}
+	}
+	else if (uniform != 0)
+	{
+		OctreeRenderer.FreeBricks = ListPush(OctreeRenderer.FreeBricks, &(int){ entry });
+		entry = uniform;
+	}
+	else
+	{
+		int offset = entry * 512 + (((y & 7) << 6) | ((z & 7) << 3) | (x & 7));
+		OctreeRenderer.BrickPool[offset] = tile;
+		OctreeRendererMarkDirty(DirtyBufferBrickPool, offset, 1);
+		return;
+	}
+	
+	OctreeRenderer.Bricks[index] = entry;
+	OctreeRendererMarkDirty(DirtyBufferBricks, index * sizeof(unsigned int), sizeof(unsigned int));
+}
+
+static bool StorageSupported(BlockStorage storage, Level level)
+{
+	if (storage == BlockStorageMorton) { return level->Depth <= 64 && level->Width % 64 == 0 && level->Height % 64 == 0; }
+	if (storage == BlockStorageBrickmap) { return level->Depth % 8 == 0 && level->Width % 8 == 0 && level->Height % 8 == 0; }
+	return true;
 }
 
 void OctreeRendererSetOctree(Octree tree)
 {
+	if (OctreeRenderer.Queue != NULL) { clFinish(OctreeRenderer.Queue); }
+	ClearDirtyRanges();
 	OctreeRenderer.Octree = tree;
+	OctreeRenderer.HistoryValid = false;
+	Level level = tree->Level;
+	if (!StorageSupported(OctreeRenderer.Storage, level))
+	{
+		LogWarning("Block storage %i does not support a %ix%ix%i level, falling back to dense storage\n", OctreeRenderer.Storage, level->Width, level->Depth, level->Height);
+		OctreeRenderer.Storage = BlockStorageDense;
+	}
 
 	if (OctreeRenderer.BlockBuffer != NULL) { clReleaseMemObject(OctreeRenderer.BlockBuffer); }
+	OctreeRenderer.BlockBuffer = NULL;
+	ReleaseBrickmap();
 	if (OctreeRenderer.OctreeBuffer != NULL) { clReleaseMemObject(OctreeRenderer.OctreeBuffer); }
+	if (OctreeRenderer.HeightBuffer != NULL) { clReleaseMemObject(OctreeRenderer.HeightBuffer); }
+	if (OctreeRenderer.ColumnHeights != NULL) { MemoryFree(OctreeRenderer.ColumnHeights); }
+	if (OctreeRenderer.SunBuffer != NULL) { clReleaseMemObject(OctreeRenderer.SunBuffer); }
+	if (OctreeRenderer.BlockMirror != NULL) { MemoryFree(OctreeRenderer.BlockMirror); }
+	OctreeRenderer.BlockMirror = NULL;
+	ReleaseDistanceField();
+	
+	OctreeRenderer.ColumnHeights = MemoryAllocate(level->Width * level->Height);
+	for (int x = 0; x < level->Width; x++)
+	{
+		for (int z = 0; z < level->Height; z++)
+		{
+			int y = level->Depth;
+			while (y > 0 && LevelGetTile(level, x, y - 1, z) == BlockTypeNone) { y--; }
+			OctreeRenderer.ColumnHeights[z * level->Width + x] = y;
+		}
+	}
+	if (OctreeRenderer.Context == NULL) { return; }
 	
 	int error;
 	OctreeRenderer.OctreeBuffer = clCreateBuffer(OctreeRenderer.Context, CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR, tree->MaskCount, tree->Masks, &error);
 	if (error < 0) { LogFatal("Failed to create octree buffer: %i\n", error); }
-	OctreeRenderer.BlockBuffer = clCreateBuffer(OctreeRenderer.Context, CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR, tree->Level->Width * tree->Level->Height * tree->Level->Depth, tree->Level->Blocks, &error);
-	if (error < 0) { LogFatal("Failed to create block buffer: %i\n", error); }
+	if (OctreeRenderer.Storage == BlockStorageBrickmap) { CreateBrickmap(level); }
+	else if (OctreeRenderer.Storage == BlockStorageMorton)
+	{
+		unsigned char * blocks = MemoryAllocate(level->Width * level->Height * level->Depth);
+		for (int y = 0; y < level->Depth; y++)
+		{
+			for (int z = 0; z < level->Height; z++)
+			{
+				for (int x = 0; x < level->Width; x++) { blocks[BlockIndex(level, x, y, z)] = level->Blocks[(y * level->Height + z) * level->Width + x]; }
+			}
+		}
+		OctreeRenderer.BlockBuffer = clCreateBuffer(OctreeRenderer.Context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, level->Width * level->Height * level->Depth, blocks, &error);
+		if (error < 0) { LogFatal("Failed to create block buffer: %i\n", error); }
+		OctreeRenderer.BlockMirror = blocks;
+	}
+	else
+	{
+		OctreeRenderer.BlockBuffer = clCreateBuffer(OctreeRenderer.Context, CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR, level->Width * level->Height * level->Depth, level->Blocks, &error);
+		if (error < 0) { LogFatal("Failed to create block buffer: %i\n", error); }
+	}
+	OctreeRenderer.HeightBuffer = clCreateBuffer(OctreeRenderer.Context, CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR, level->Width * level->Height, OctreeRenderer.ColumnHeights, &error);
+	if (error < 0) { LogFatal("Failed to create height buffer: %i\n", error); }
+	OctreeRenderer.SunBuffer = clCreateBuffer(OctreeRenderer.Context, CL_MEM_READ_WRITE, level->Width * level->Height * level->Depth * SunEntries * sizeof(cl_uchar4), NULL, &error);
+	if (error < 0) { LogFatal("Failed to create sun visibility buffer: %i\n", error); }
+	OctreeRenderer.SunRebuild = true;
 	
-	error = clSetKernelArg(OctreeRenderer.Kernel, 0, sizeof(unsigned int), &tree->Depth);
-	error |= clSetKernelArg(OctreeRenderer.Kernel, 1, sizeof(cl_mem), &OctreeRenderer.OctreeBuffer);
-	error |= clSetKernelArg(OctreeRenderer.Kernel, 2, sizeof(cl_mem), &OctreeRenderer.BlockBuffer);
+	if (OctreeRenderer.TraversalMode == TraversalModeDistanceField) { BuildDistanceField(); }
+}
+
+void OctreeRendererUpdateTile(int x, int y, int z, BlockType tile)
+{
+	if (OctreeRenderer.ColumnHeights == NULL) { return; }
+	Level level = OctreeRenderer.Octree->Level;
+	float3 * dirtyMin = &OctreeRenderer.DirtyMin, * dirtyMax = &OctreeRenderer.DirtyMax;
+	*dirtyMin = (float3){ fminf(dirtyMin->x, x), fminf(dirtyMin->y, y), fminf(dirtyMin->z, z) };
+	*dirtyMax = (float3){ fmaxf(dirtyMax->x, x + 1), fmaxf(dirtyMax->y, y + 1), fmaxf(dirtyMax->z, z + 1) };
+	
+	int column = z * level->Width + x;
+	int height = OctreeRenderer.ColumnHeights[column];
+	if (tile != BlockTypeNone && y >= height) { height = y + 1; }
+	else if (tile == BlockTypeNone && y == height - 1)
+	{
+		while (height > 0 && LevelGetTile(level, x, height - 1, z) == BlockTypeNone) { height--; }
+	}
+	if (height != OctreeRenderer.ColumnHeights[column])
+	{
+		OctreeRenderer.ColumnHeights[column] = height;
+		OctreeRendererMarkDirty(DirtyBufferHeights, column, 1);
+	}
+	
+	if (OctreeRenderer.Context == NULL) { return; }
+	if (OctreeRenderer.Storage == BlockStorageBrickmap) { UpdateBrick(level, x, y, z, tile); }
+	else
+	{
+		int index = BlockIndex(level, x, y, z);
+		if (OctreeRenderer.BlockMirror != NULL) { OctreeRenderer.BlockMirror[index] = tile; }
+		OctreeRendererMarkDirty(DirtyBufferBlocks, index, 1);
+	}
+	if (OctreeRenderer.DistanceBuffer != NULL) { OctreeRenderer.DirtyTiles = ListPush(OctreeRenderer.DirtyTiles, &(int3){ x, y, z }); }
+}
+
+void OctreeRendererSetTraversalMode(TraversalMode mode)
+{
+	OctreeRenderer.TraversalMode = mode;
+	if (mode != TraversalModeDistanceField) { ReleaseDistanceField(); }
+	else if (OctreeRenderer.DistanceBuffer == NULL && OctreeRenderer.Octree != NULL && OctreeRenderer.Context != NULL) { BuildDistanceField(); }
+}
+
+void OctreeRendererSetBlockStorage(BlockStorage storage)
+{
+	if (storage == OctreeRenderer.Storage) { return; }
+	OctreeRenderer.Storage = storage;
+	if (OctreeRenderer.Octree != NULL) { OctreeRendererSetOctree(OctreeRenderer.Octree); }
+}
+
+void OctreeRendererSetPipeline(RenderPipeline pipeline)
+{
+	if (OctreeRenderer.Context == NULL)
+	{
+		OctreeRenderer.Pipeline = RenderPipelineCPU;
+		return;
+	}
+	if (OctreeRenderer.Headless && pipeline == RenderPipelineCPU) { pipeline = RenderPipelineMegakernel; }
+	if (pipeline == RenderPipelineCPU && OctreeRenderer.Pipeline != RenderPipelineCPU)
+	{
+		clFinish(OctreeRenderer.Queue);
+		FinishFrame(0);
+		FinishFrame(1);
+		OctreeRenderer.HistoryValid = false;
+	}
+	if (pipeline != RenderPipelineCPU && OctreeRenderer.Pipeline == RenderPipelineCPU)
+	{
+		OctreeRenderer.SunRebuild = true;
+		OctreeRenderer.CheckerboardHistory = false;
+	}
+	OctreeRenderer.Pipeline = pipeline;
+	if (pipeline != RenderPipelineWavefront) { ReleaseWavefront(); }
+	else if (OctreeRenderer.PathBuffer == NULL) { CreateWavefront(); }
+}
+
+static void SetWorldArguments(cl_kernel kernel, float time)
+{
+	int error = clSetKernelArg(kernel, 0, sizeof(unsigned int), &OctreeRenderer.Octree->Depth);
+	error |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &OctreeRenderer.OctreeBuffer);
+	error |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &OctreeRenderer.BlockBuffer);
+	error |= clSetKernelArg(kernel, 3, sizeof(cl_mem), &OctreeRenderer.BrickBuffer);
+	error |= clSetKernelArg(kernel, 4, sizeof(cl_mem), &OctreeRenderer.BrickPoolBuffer);
+	error |= clSetKernelArg(kernel, 5, sizeof(int), &(int){ OctreeRenderer.Storage });
+	error |= clSetKernelArg(kernel, 6, sizeof(cl_mem), &OctreeRenderer.HeightBuffer);
+	error |= clSetKernelArg(kernel, 7, sizeof(cl_mem), &OctreeRenderer.DistanceBuffer);
+	error |= clSetKernelArg(kernel, 8, sizeof(int), &(int){ OctreeRenderer.TraversalMode });
+	error |= clSetKernelArg(kernel, 9, sizeof(cl_mem), &OctreeRenderer.TerrainTexture);
+	error |= clSetKernelArg(kernel, 10, sizeof(float), &time);
+	error |= clSetKernelArg(kernel, 11, sizeof(cl_mem), OctreeRenderer.CollectStatistics ? &OctreeRenderer.StatisticsBuffer : NULL);
+	error |= clSetKernelArg(kernel, 12, sizeof(cl_mem), OctreeRenderer.ShadingCaches ? &OctreeRenderer.SunBuffer : NULL);
+	error |= clSetKernelArg(kernel, 13, sizeof(cl_mem), OctreeRenderer.ShadingCaches ? &OctreeRenderer.CloudBuffer : NULL);
+	error |= clSetKernelArg(kernel, 14, sizeof(cl_mem), &OctreeRenderer.MaterialBuffer);
 	if (error < 0) { LogFatal("Failed to set kernel arguments: %i\n", error); }
 }
 
+static void EnqueueSunVisibility(float time, int3 regionMin, int3 regionMax)
+{
+	SetWorldArguments(OctreeRenderer.SunKernel, time);
+	int3 size = regionMax - regionMin;
+	if (size.x <= 0 || size.y <= 0 || size.z <= 0) { return; }
+	int error = clEnqueueNDRangeKernel(OctreeRenderer.Queue, OctreeRenderer.SunKernel, 3, (size_t[]){ regionMin.x, regionMin.y, regionMin.z }, (size_t[]){ size.x, size.y, size.z }, NULL, 0, NULL, NULL);
+	if (error < 0) { LogFatal("Failed to enqueue sun visibility pass: %i\n", error); }
+}
+
+static void UpdateSunVisibility(float time)
+{
+	Level level = OctreeRenderer.Octree->Level;
+	int3 levelMax = { level->Width, level->Depth, level->Height };
+	if (OctreeRenderer.SunRebuild)
+	{
+		EnqueueSunVisibility(time, (int3){ 0, 0, 0 }, levelMax);
+		OctreeRenderer.SunRebuild = false;
+		return;
+	}
+	float3 dirtyMin = OctreeRenderer.DirtyMin, dirtyMax = OctreeRenderer.DirtyMax;
+	if (dirtyMin.x >= dirtyMax.x) { return; }
+	float3 light = LightDirection;
+	float3 reach = light * dirtyMax.y / light.y;
+	int3 regionMin = { (int)floor(dirtyMin.x - fmax(reach.x, 0.0)) - 1, 0, (int)floor(dirtyMin.z - fmax(reach.z, 0.0)) - 1 };
+	int3 regionMax = { (int)ceil(dirtyMax.x + fmax(-reach.x, 0.0)) + 1, (int)dirtyMax.y, (int)ceil(dirtyMax.z + fmax(-reach.z, 0.0)) + 1 };
+	EnqueueSunVisibility(time, ClampToLevel(regionMin, levelMax), ClampToLevel(regionMax, levelMax));
+}
+
+static void UpdateCloudLayer(float3 position, float time)
+{
+	float2 offset = position.xz - OctreeRenderer.CloudCenter;
+	if (time == OctreeRenderer.CloudTime && sqrt(offset.x * offset.x + offset.y * offset.y) < CloudRecenterDistance) { return; }
+	OctreeRenderer.CloudTime = time;
+	OctreeRenderer.CloudCenter = position.xz;
+	cl_float2 origin = { .s = { position.x - CloudLayerSize * CloudTexelSize / 2.0, position.z - CloudLayerSize * CloudTexelSize / 2.0 } };
+	cl_kernel kernel = OctreeRenderer.CloudKernel;
+	int error = clSetKernelArg(kernel, 0, sizeof(cl_mem), &OctreeRenderer.CloudBuffer);
+	error |= clSetKernelArg(kernel, 1, sizeof(cl_float2), &origin);
+	error |= clSetKernelArg(kernel, 2, sizeof(float), &time);
+	if (error < 0) { LogFatal("Failed to set kernel arguments: %i\n", error); }
+	error = clEnqueueNDRangeKernel(OctreeRenderer.Queue, kernel, 2, NULL, (size_t[]){ CloudLayerSize, CloudLayerSize }, (size_t[]){ 16, 16 }, 0, NULL, NULL);
+	if (error < 0) { LogFatal("Failed to enqueue cloud layer: %i\n", error); }
+}
+
+static void AddStageTime(WavefrontStage stage, cl_event event)
+{
+	float time = EventTime(event);
+	OctreeRenderer.StageTimes[stage] += time;
+	OctreeRenderer.PendingProfiles[OctreeRenderer.OutputIndex].Stages[ProfileStageTrace] += time;
+	clReleaseEvent(event);
+}
+
+static void EnqueueBeam(Matrix4x4 camera, bool isUnderWater, float time)
+{
+	cl_kernel kernel = OctreeRenderer.BeamKernel;
+	SetWorldArguments(kernel, time);
+	int error = clSetKernelArg(kernel, 15, sizeof(cl_mem), &OctreeRenderer.StartBuffer);
+	error |= clSetKernelArg(kernel, 16, sizeof(int), &OctreeRenderer.Width);
+	error |= clSetKernelArg(kernel, 17, sizeof(int), &OctreeRenderer.Height);
+	error |= clSetKernelArg(kernel, 18, sizeof(Matrix4x4), &camera);
+	error |= clSetKernelArg(kernel, 19, sizeof(int), &(int){ isUnderWater });
+	if (error < 0) { LogFatal("Failed to set kernel arguments: %i\n", error); }
+	size_t tiles[] = { (OctreeRenderer.Width + BeamTileSize - 1) / BeamTileSize, (OctreeRenderer.Height + BeamTileSize - 1) / BeamTileSize };
+	error = clEnqueueNDRangeKernel(OctreeRenderer.Queue, kernel, 2, NULL, (size_t[]){ tiles[0] + (8 - tiles[0] % 8) % 8, tiles[1] + (8 - tiles[1] % 8) % 8 }, (size_t[]){ 8, 8 }, 0, NULL, NULL);
+	if (error < 0) { LogFatal("Failed to enqueue beam prepass: %i\n", error); }
+}
+
+static void EnqueueReprojection(Matrix4x4 camera, size_t * globalSize, bool checkerboard)
+{
+	cl_uint infinity = 0x7f800000;
+	int error = clEnqueueFillBuffer(OctreeRenderer.Queue, OctreeRenderer.HintBuffer, &infinity, sizeof(infinity), 0, OctreeRenderer.Width * OctreeRenderer.Height * sizeof(cl_uint), 0, NULL, NULL);
+	if (error < 0) { LogFatal("Failed to clear hint buffer: %i\n", error); }
+	cl_kernel kernel = OctreeRenderer.ReprojectKernel;
+	error = clSetKernelArg(kernel, 0, sizeof(cl_mem), &OctreeRenderer.DepthBuffer);
+	error |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &OctreeRenderer.HintBuffer);
+	error |= clSetKernelArg(kernel, 2, sizeof(int), &OctreeRenderer.Width);
+	error |= clSetKernelArg(kernel, 3, sizeof(int), &OctreeRenderer.Height);
+	error |= clSetKernelArg(kernel, 4, sizeof(Matrix4x4), &OctreeRenderer.PreviousCamera);
+	error |= clSetKernelArg(kernel, 5, sizeof(Matrix4x4), &camera);
+	error |= clSetKernelArg(kernel, 6, sizeof(int), &(int){ checkerboard ? 1 : 0 });
+	if (error < 0) { LogFatal("Failed to set kernel arguments: %i\n", error); }
+	size_t groupSize[2];
+	KernelGroupSize(kernel, OctreeRenderer.Device, OctreeRenderer.GroupSize, groupSize);
+	error = clEnqueueNDRangeKernel(OctreeRenderer.Queue, kernel, 2, NULL, globalSize, groupSize, 0, NULL, NULL);
+	if (error < 0) { LogFatal("Failed to enqueue reprojection: %i\n", error); }
+}
+
+static void EnqueueReconstruction(Matrix4x4 camera, size_t * globalSize, int parity)
+{
+	cl_kernel kernel = OctreeRenderer.ReconstructKernel;
+	int error = clSetKernelArg(kernel, 0, sizeof(cl_mem), &OctreeRenderer.RenderImage);
+	error |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &OctreeRenderer.HistoryImages[!OctreeRenderer.HistoryIndex]);
+	error |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &OctreeRenderer.HistoryImages[OctreeRenderer.HistoryIndex]);
+	error |= clSetKernelArg(kernel, 3, sizeof(cl_mem), &OctreeRenderer.DepthBuffer);
+	error |= clSetKernelArg(kernel, 4, sizeof(int), &OctreeRenderer.Width);
+	error |= clSetKernelArg(kernel, 5, sizeof(int), &OctreeRenderer.Height);
+	error |= clSetKernelArg(kernel, 6, sizeof(Matrix4x4), &camera);
+	error |= clSetKernelArg(kernel, 7, sizeof(Matrix4x4), &OctreeRenderer.PreviousCamera);
+	error |= clSetKernelArg(kernel, 8, sizeof(int), &parity);
+	error |= clSetKernelArg(kernel, 9, sizeof(int), &(int){ OctreeRenderer.CheckerboardHistory });
+	if (error < 0) { LogFatal("Failed to set kernel arguments: %i\n", error); }
+	size_t groupSize[2];
+	KernelGroupSize(kernel, OctreeRenderer.Device, OctreeRenderer.GroupSize, groupSize);
+	error = clEnqueueNDRangeKernel(OctreeRenderer.Queue, kernel, 2, NULL, globalSize, groupSize, 0, NULL, NULL);
+	if (error < 0) { LogFatal("Failed to enqueue reconstruction: %i\n", error); }
+}
+
+static void EnqueueHeatmap(size_t * globalSize)
+{
+	static const float scales[] = { 1.0, 256.0, 8.0, 256.0, 256.0 };
+	cl_kernel kernel = OctreeRenderer.HeatmapKernel;
+	int error = clSetKernelArg(kernel, 0, sizeof(cl_mem), &OctreeRenderer.CounterBuffer);
+	error |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &OctreeRenderer.RenderImage);
+	error |= clSetKernelArg(kernel, 2, sizeof(int), &OctreeRenderer.Width);
+	error |= clSetKernelArg(kernel, 3, sizeof(int), &OctreeRenderer.Height);
+	error |= clSetKernelArg(kernel, 4, sizeof(int), &(int){ OctreeRenderer.Heatmap - RayHeatmapSteps });
+	error |= clSetKernelArg(kernel, 5, sizeof(float), &scales[OctreeRenderer.Heatmap]);
+	if (error < 0) { LogFatal("Failed to set kernel arguments: %i\n", error); }
+	size_t groupSize[2];
+	KernelGroupSize(kernel, OctreeRenderer.Device, OctreeRenderer.GroupSize, groupSize);
+	error = clEnqueueNDRangeKernel(OctreeRenderer.Queue, kernel, 2, NULL, globalSize, groupSize, 0, NULL, NULL);
+	if (error < 0) { LogFatal("Failed to enqueue heatmap: %i\n", error); }
+}
+
+void OctreeRendererSetHeatmap(RayHeatmap heatmap)
+{
+	if (heatmap < RayHeatmapOff || heatmap >= RayHeatmapCount) { heatmap = RayHeatmapOff; }
+	if (heatmap == OctreeRenderer.Heatmap) { return; }
+	ReleaseRenderTarget();
+	OctreeRenderer.Heatmap = heatmap;
+	CreateRenderTarget();
+}
+
+bool OctreeRendererHeatmapSupported()
+{
+	return OctreeRenderer.Pipeline != RenderPipelineWavefront && OctreeRenderer.Pipeline != RenderPipelineCPU;
+}
+
+void OctreeRendererSetCheckerboard(bool enabled)
+{
+	OctreeRenderer.Checkerboard = enabled;
+	OctreeRenderer.CheckerboardHistory = false;
+}
+
+static void EnqueueWavefront(Matrix4x4 camera, bool isUnderWater, float time, size_t * globalSize)
+{
+	cl_kernel * kernels = OctreeRenderer.WavefrontKernels;
+	for (int i = 0; i < WavefrontStageResolve; i++) { SetWorldArguments(kernels[i], time); }
+	for (int i = 0; i < WavefrontStageCount; i++) { OctreeRenderer.StageTimes[i] = 0.0; }
+	
+	cl_event events[WavefrontStageCount];
+	size_t groupSize[2];
+	int error = clSetKernelArg(kernels[WavefrontStageGenerate], 15, sizeof(cl_mem), &OctreeRenderer.PathBuffer);
+	error |= clSetKernelArg(kernels[WavefrontStageGenerate], 16, sizeof(cl_mem), &OctreeRenderer.PathQueues[0]);
+	error |= clSetKernelArg(kernels[WavefrontStageGenerate], 17, sizeof(int), &OctreeRenderer.Width);
+	error |= clSetKernelArg(kernels[WavefrontStageGenerate], 18, sizeof(int), &OctreeRenderer.Height);
+	error |= clSetKernelArg(kernels[WavefrontStageGenerate], 19, sizeof(Matrix4x4), &camera);
+	error |= clSetKernelArg(kernels[WavefrontStageGenerate], 20, sizeof(int), &(int){ isUnderWater });
+	error |= clSetKernelArg(kernels[WavefrontStageGenerate], 21, sizeof(cl_mem), OctreeRenderer.BeamPrepass ? &OctreeRenderer.StartBuffer : NULL);
+	if (error < 0) { LogFatal("Failed to set kernel arguments: %i\n", error); }
+	KernelGroupSize(kernels[WavefrontStageGenerate], OctreeRenderer.Device, (size_t[]){ WavefrontGroupSize, WavefrontGroupSize }, groupSize);
+	error = clEnqueueNDRangeKernel(OctreeRenderer.Queue, kernels[WavefrontStageGenerate], 2, NULL, globalSize, groupSize, 0, NULL, &events[WavefrontStageGenerate]);
+	if (error < 0) { LogFatal("Failed to enqueue wavefront stage: %i\n", error); }
+	
+	cl_uint pixels = OctreeRenderer.Width * OctreeRenderer.Height, bound = pixels;
+	cl_uint counts[WavefrontBounceMax];
+	cl_event stages[WavefrontBounceMax][WavefrontStageCount], reads[WavefrontBounceMax];
+	error = clEnqueueFillBuffer(OctreeRenderer.Queue, OctreeRenderer.QueueCounters, &(cl_uint){ 0 }, sizeof(cl_uint), 0, 4 * (WavefrontBounceMax + 1) * sizeof(cl_uint), 0, NULL, NULL);
+	error |= clEnqueueWriteBuffer(OctreeRenderer.Queue, OctreeRenderer.QueueCounters, false, 0, sizeof(cl_uint), &pixels, 0, NULL, NULL);
+	if (error < 0) { LogFatal("Failed to clear queue counters: %i\n", error); }
+	
+	error = clSetKernelArg(kernels[WavefrontStageExtend], 15, sizeof(cl_mem), &OctreeRenderer.PathBuffer);
+	error |= clSetKernelArg(kernels[WavefrontStageExtend], 19, sizeof(cl_mem), &OctreeRenderer.ShadeQueue);
+	error |= clSetKernelArg(kernels[WavefrontStageExtend], 20, sizeof(cl_mem), &OctreeRenderer.QueueCounters);
+	error |= clSetKernelArg(kernels[WavefrontStageShade], 15, sizeof(cl_mem), &OctreeRenderer.PathBuffer);
+	error |= clSetKernelArg(kernels[WavefrontStageShade], 16, sizeof(cl_mem), &OctreeRenderer.ShadeQueue);
+	error |= clSetKernelArg(kernels[WavefrontStageShade], 17, sizeof(cl_mem), &OctreeRenderer.QueueCounters);
+	error |= clSetKernelArg(kernels[WavefrontStageShade], 19, sizeof(cl_mem), &OctreeRenderer.ShadowQueue);
+	error |= clSetKernelArg(kernels[WavefrontStageShade], 20, sizeof(cl_mem), &OctreeRenderer.ReflectQueue);
+	error |= clSetKernelArg(kernels[WavefrontStageShadow], 15, sizeof(cl_mem), &OctreeRenderer.PathBuffer);
+	error |= clSetKernelArg(kernels[WavefrontStageShadow], 16, sizeof(cl_mem), &OctreeRenderer.ShadowQueue);
+	error |= clSetKernelArg(kernels[WavefrontStageShadow], 17, sizeof(cl_mem), &OctreeRenderer.QueueCounters);
+	error |= clSetKernelArg(kernels[WavefrontStageReflect], 15, sizeof(cl_mem), &OctreeRenderer.PathBuffer);
+	error |= clSetKernelArg(kernels[WavefrontStageReflect], 16, sizeof(cl_mem), &OctreeRenderer.ReflectQueue);
+	error |= clSetKernelArg(kernels[WavefrontStageReflect], 17, sizeof(cl_mem), &OctreeRenderer.QueueCounters);
+	if (error < 0) { LogFatal("Failed to set kernel arguments: %i\n", error); }
+	
+	int bounces = 0;
+	for (int current = 0; bounces < WavefrontBounceMax && bound > 0; current = !current, bounces++)
+	{
+		cl_uint bounce = bounces;
+		error = clSetKernelArg(kernels[WavefrontStageExtend], 16, sizeof(cl_mem), &OctreeRenderer.PathQueues[current]);
+		error |= clSetKernelArg(kernels[WavefrontStageExtend], 17, sizeof(cl_uint), &bounce);
+		error |= clSetKernelArg(kernels[WavefrontStageExtend], 18, sizeof(cl_mem), &OctreeRenderer.PathQueues[!current]);
+		error |= clSetKernelArg(kernels[WavefrontStageShade], 18, sizeof(cl_mem), &OctreeRenderer.PathQueues[!current]);
+		error |= clSetKernelArg(kernels[WavefrontStageShade], 21, sizeof(cl_uint), &bounce);
+		error |= clSetKernelArg(kernels[WavefrontStageShadow], 18, sizeof(cl_uint), &bounce);
+		error |= clSetKernelArg(kernels[WavefrontStageReflect], 18, sizeof(cl_uint), &bounce);
+		if (error < 0) { LogFatal("Failed to set kernel arguments: %i\n", error); }
+		
+		size_t queueSize = bound + (64 - bound % 64) % 64;
+		for (int i = WavefrontStageExtend; i <= WavefrontStageReflect; i++)
+		{
+			error = clEnqueueNDRangeKernel(OctreeRenderer.Queue, kernels[i], 1, NULL, &queueSize, (size_t[]){ 64 }, 0, NULL, &stages[bounces][i]);
+			if (error < 0) { LogFatal("Failed to enqueue wavefront stage: %i\n", error); }
+		}
+		error = clEnqueueReadBuffer(OctreeRenderer.Queue, OctreeRenderer.QueueCounters, false, 4 * (bounce + 1) * sizeof(cl_uint), sizeof(cl_uint), &counts[bounces], 0, NULL, &reads[bounces]);
+		if (error < 0) { LogFatal("Failed to read queue counters: %i\n", error); }
+		clFlush(OctreeRenderer.Queue);
+		if (bounces > 0) { clWaitForEvents(1, &reads[bounces - 1]); bound = counts[bounces - 1]; }
+	}
+	
+	KernelGroupSize(kernels[WavefrontStageResolve], OctreeRenderer.Device, (size_t[]){ WavefrontGroupSize, WavefrontGroupSize }, groupSize);
+	error = clEnqueueNDRangeKernel(OctreeRenderer.Queue, kernels[WavefrontStageResolve], 2, NULL, globalSize, groupSize, 0, NULL, &events[WavefrontStageResolve]);
+	if (error < 0) { LogFatal("Failed to enqueue wavefront stage: %i\n", error); }
+	clWaitForEvents(1, &events[WavefrontStageResolve]);
+	for (int i = 0; i < bounces; i++)
+	{
+		for (int j = WavefrontStageExtend; j <= WavefrontStageReflect; j++) { AddStageTime(j, stages[i][j]); }
+		clReleaseEvent(reads[i]);
+	}
+	AddStageTime(WavefrontStageGenerate, events[WavefrontStageGenerate]);
+	AddStageTime(WavefrontStageResolve, events[WavefrontStageResolve]);
+}
+
+static int SetTraceArguments(cl_kernel kernel, cl_mem output, cl_mem terrain, Matrix4x4 camera, bool isUnderWater, float time, cl_mem stats, cl_mem hints, cl_mem depths, int parity, cl_mem counters)
+{
+	int error = clSetKernelArg(kernel, 0, sizeof(unsigned int), &OctreeRenderer.Octree->Depth);
+	error |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &OctreeRenderer.OctreeBuffer);
+	error |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &OctreeRenderer.BlockBuffer);
+	error |= clSetKernelArg(kernel, 3, sizeof(cl_mem), &output);
+	error |= clSetKernelArg(kernel, 4, sizeof(int), &OctreeRenderer.Width);
+	error |= clSetKernelArg(kernel, 5, sizeof(int), &OctreeRenderer.Height);
+	error |= clSetKernelArg(kernel, 6, sizeof(Matrix4x4), &camera);
+	error |= clSetKernelArg(kernel, 7, sizeof(cl_mem), &terrain);
+	error |= clSetKernelArg(kernel, 8, sizeof(int), &(int){ isUnderWater });
+	error |= clSetKernelArg(kernel, 9, sizeof(float), &time);
+	error |= clSetKernelArg(kernel, 10, sizeof(cl_mem), stats != NULL ? &stats : NULL);
+	error |= clSetKernelArg(kernel, 11, sizeof(cl_mem), &OctreeRenderer.HeightBuffer);
+	error |= clSetKernelArg(kernel, 12, sizeof(cl_mem), OctreeRenderer.DistanceBuffer != NULL ? &OctreeRenderer.DistanceBuffer : NULL);
+	error |= clSetKernelArg(kernel, 13, sizeof(int), &(int){ OctreeRenderer.TraversalMode });
+	error |= clSetKernelArg(kernel, 14, sizeof(cl_mem), &OctreeRenderer.BrickBuffer);
+	error |= clSetKernelArg(kernel, 15, sizeof(cl_mem), &OctreeRenderer.BrickPoolBuffer);
+	error |= clSetKernelArg(kernel, 16, sizeof(int), &(int){ OctreeRenderer.Storage });
+	error |= clSetKernelArg(kernel, 17, sizeof(cl_mem), OctreeRenderer.BeamPrepass ? &OctreeRenderer.StartBuffer : NULL);
+	error |= clSetKernelArg(kernel, 18, sizeof(cl_mem), hints != NULL ? &hints : NULL);
+	error |= clSetKernelArg(kernel, 19, sizeof(cl_mem), depths != NULL ? &depths : NULL);
+	error |= clSetKernelArg(kernel, 20, sizeof(cl_float4), &(cl_float4){ .s = { OctreeRenderer.DirtyMin.x, OctreeRenderer.DirtyMin.y, OctreeRenderer.DirtyMin.z, 0.0 } });
+	error |= clSetKernelArg(kernel, 21, sizeof(cl_float4), &(cl_float4){ .s = { OctreeRenderer.DirtyMax.x, OctreeRenderer.DirtyMax.y, OctreeRenderer.DirtyMax.z, 0.0 } });
+	error |= clSetKernelArg(kernel, 22, sizeof(int), &parity);
+	error |= clSetKernelArg(kernel, 23, sizeof(cl_mem), OctreeRenderer.ShadingCaches ? &OctreeRenderer.SunBuffer : NULL);
+	error |= clSetKernelArg(kernel, 24, sizeof(cl_mem), OctreeRenderer.ShadingCaches ? &OctreeRenderer.CloudBuffer : NULL);
+	error |= clSetKernelArg(kernel, 25, sizeof(cl_mem), counters != NULL ? &counters : NULL);
+	error |= clSetKernelArg(kernel, 26, sizeof(cl_mem), &OctreeRenderer.MaterialBuffer);
+	return error;
+}
+
+static void BalanceSplitFrame()
+{
+	list(SplitDevice) devices = OctreeRenderer.SplitDevices;
+	float speeds[SplitDeviceMax], measuredShare = 0.0, measuredSpeed = 0.0;
+	for (int i = 0; i < ListCount(devices); i++)
+	{
+		cl_int status = CL_COMPLETE;
+		if (devices[i].Event != NULL) { clGetEventInfo(devices[i].Event, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(status), &status, NULL); }
+		if (status != CL_COMPLETE) { return; }
+	}
+	for (int i = 0; i < ListCount(devices); i++)
+	{
+		speeds[i] = 0.0;
+		if (devices[i].Event == NULL) { continue; }
+		cl_ulong start, end;
+		clGetEventProfilingInfo(devices[i].Event, CL_PROFILING_COMMAND_START, sizeof(start), &start, NULL);
+		clGetEventProfilingInfo(devices[i].Event, CL_PROFILING_COMMAND_END, sizeof(end), &end, NULL);
+		clReleaseEvent(devices[i].Event);
+		devices[i].Event = NULL;
+		speeds[i] = (devices[i].End - devices[i].Start) / fmax((end - start) / 1000000.0, 0.01);
+		measuredShare += devices[i].Share;
+		measuredSpeed += speeds[i];
+	}
+	if (measuredSpeed <= 0.0) { return; }
+	float total = 0.0;
+	for (int i = 0; i < ListCount(devices); i++)
+	{
+		if (speeds[i] > 0.0) { devices[i].Share = fmax(0.5 * devices[i].Share + 0.5 * measuredShare * speeds[i] / measuredSpeed, SplitShareMin); }
+		total += devices[i].Share;
+	}
+	for (int i = 0; i < ListCount(devices); i++) { devices[i].Share /= total; }
+}
+
+static void EnqueueSplitFrame(cl_kernel kernel, TraceVariant variant, Matrix4x4 camera, bool isUnderWater, float time, size_t * globalSize)
+{
+	list(SplitDevice) devices = OctreeRenderer.SplitDevices;
+	BalanceSplitFrame();
+	bool timed = true;
+	for (int i = 0; i < ListCount(devices); i++) { timed &= devices[i].Event == NULL; }
+	
+	size_t groupSize[2];
+	KernelGroupSize(kernel, OctreeRenderer.Device, OctreeRenderer.GroupSize, groupSize);
+	int w = OctreeRenderer.Width, h = OctreeRenderer.Height;
+	int error;
+	if (OctreeRenderer.TerrainDirty)
+	{
+		size_t terrainSize[2];
+		clGetImageInfo(OctreeRenderer.TerrainCopy, CL_IMAGE_WIDTH, sizeof(size_t), &terrainSize[0], NULL);
+		clGetImageInfo(OctreeRenderer.TerrainCopy, CL_IMAGE_HEIGHT, sizeof(size_t), &terrainSize[1], NULL);
+		error = clEnqueueCopyImage(OctreeRenderer.Queue, OctreeRenderer.TerrainTexture, OctreeRenderer.TerrainCopy, (size_t[]){ 0, 0, 0 }, (size_t[]){ 0, 0, 0 }, (size_t[]){ terrainSize[0], terrainSize[1], 1 }, 0, NULL, NULL);
+		if (error < 0) { LogFatal("Failed to copy terrain: %i\n", error); }
+		OctreeRenderer.TerrainDirty = false;
+	}
+	cl_event ready;
+	error = clEnqueueMarkerWithWaitList(OctreeRenderer.Queue, 0, NULL, &ready);
+	if (error < 0) { LogFatal("Failed to enqueue marker: %i\n", error); }
+	clFlush(OctreeRenderer.Queue);
+	
+	int start = 0;
+	for (int i = 0; i < ListCount(devices); i++)
+	{
+		SplitDevice * device = &devices[i];
+		int rows = i == ListCount(devices) - 1 ? h - start : (int)(h * device->Share / groupSize[1] + 0.5) * groupSize[1];
+		rows = rows < groupSize[1] ? groupSize[1] : rows;
+		rows = rows > h - start ? h - start : rows;
+		device->Start = start;
+		device->End = start + rows;
+		start += rows;
+		if (rows == 0) { continue; }
+		
+		cl_event * event = timed ? &device->Event : NULL;
+		if (i == 0)
+		{
+			error = clEnqueueNDRangeKernel(OctreeRenderer.Queue, kernel, 2, NULL, (size_t[]){ globalSize[0], rows + (groupSize[1] - rows % groupSize[1]) % groupSize[1] }, groupSize, 0, NULL, event);
+			if (error < 0) { LogFatal("Failed to enqueue octree renderer: %i\n", error); }
+			continue;
+		}
+		
+		if (rows > device->BandHeight) { CreateBandImage(device, fmin(ceil(rows + h * SplitBandSlack), h)); }
+		cl_kernel band = device->Kernels[variant];
+		error = SetTraceArguments(band, device->BandImage, OctreeRenderer.TerrainCopy, camera, isUnderWater, time, NULL, NULL, NULL, -1, NULL);
+		if (error < 0) { LogFatal("Failed to set kernel argument: %i\n", error); }
+		cl_event done;
+		error = clEnqueueNDRangeKernel(device->Queue, band, 2, (size_t[]){ 0, device->Start }, (size_t[]){ w, rows }, NULL, 1, &ready, &done);
+		if (error < 0) { LogFatal("Failed to enqueue octree renderer: %i\n", error); }
+		clFlush(device->Queue);
+		error = clEnqueueCopyImage(OctreeRenderer.Queue, device->BandImage, OctreeRenderer.RenderImage, (size_t[]){ 0, 0, 0 }, (size_t[]){ 0, device->Start, 0 }, (size_t[]){ w, rows, 1 }, 1, &done, NULL);
+		if (error < 0) { LogFatal("Failed to copy band image: %i\n", error); }
+		if (timed) { device->Event = done; }
+		else { clReleaseEvent(done); }
+	}
+	clReleaseEvent(ready);
+}
+
+static void RunGroupSizeTuning(cl_kernel kernel, Matrix4x4 camera, bool isUnderWater, float time)
+{
+	int error;
+	cl_image_desc description = { .image_type = CL_MEM_OBJECT_IMAGE2D, .image_width = OctreeRenderer.Width, .image_height = OctreeRenderer.Height };
+	cl_mem scratch = clCreateImage(OctreeRenderer.Context, CL_MEM_WRITE_ONLY, &(cl_image_format){ CL_RGBA, CL_UNORM_INT8 }, &description, NULL, &error);
+	if (error < 0) { LogFatal("Failed to create tuning image: %i\n", error); }
+	error = SetTraceArguments(kernel, scratch, OctreeRenderer.TerrainTexture, camera, isUnderWater, time, NULL, NULL, NULL, -1, NULL);
+	if (error < 0) { LogFatal("Failed to set kernel argument: %i\n", error); }
+	if (!OctreeRenderer.Headless)
+	{
+		glFinish();
+		error = clEnqueueAcquireGLObjects(OctreeRenderer.Queue, 1, &OctreeRenderer.TerrainTexture, 0, NULL, NULL);
+		if (error < 0) { LogFatal("Failed to aquire gl texture: %i\n", error); }
+	}
+	TuneGroupSize(kernel);
+	if (!OctreeRenderer.Headless)
+	{
+		error = clEnqueueReleaseGLObjects(OctreeRenderer.Queue, 1, &OctreeRenderer.TerrainTexture, 0, NULL, NULL);
+		if (error < 0) { LogFatal("Failed to release gl texture: %i\n", error); }
+	}
+	clFinish(OctreeRenderer.Queue);
+	clReleaseMemObject(scratch);
+}
+
 void OctreeRendererEnqueue(float dt, float time, bool doBobbing)
 {
 	Player player = OctreeRenderer.Octree->Level->Player;
@@ -151,33 +1632,209 @@ void OctreeRendererEnqueue(float dt, float time, bool doBobbing)
 		camera = Matrix4x4Multiply(camera, bobbing);
 	}
 	
-	glFinish();
-	int error = clSetKernelArg(OctreeRenderer.Kernel, 6, sizeof(Matrix4x4), &camera);
-	error |= clSetKernelArg(OctreeRenderer.Kernel, 8, sizeof(int), &(int){ EntityIsUnderWater(player) });
-	error |= clSetKernelArg(OctreeRenderer.Kernel, 9, sizeof(float), &time);
+	OctreeRenderer.PendingProfiles[OctreeRenderer.OutputIndex] = (FrameProfile){ .TickTime = OctreeRenderer.TickTime };
+	if (OctreeRenderer.Context == NULL) { ClearDirtyRanges(); }
+	else { FlushDirtyRanges(); }
+	if (OctreeRenderer.Pipeline == RenderPipelineCPU)
+	{
+		UpdateRenderScale();
+		CPURendererRender(OctreeRenderer.Octree->Level, OctreeRenderer.ColumnHeights, camera, EntityIsUnderWater(player), time, OctreeRenderer.TerrainID, OctreeRenderer.TextureIDs[0], OctreeRenderer.Width, OctreeRenderer.Height, OctreeRenderer.FrameWidth, OctreeRenderer.FrameHeight);
+		OctreeRenderer.TextureID = OctreeRenderer.TextureIDs[0];
+		OctreeRenderer.OutputIndex = 0;
+		OctreeRenderer.KernelTime = CPURenderer.RenderTime;
+		OctreeRenderer.PresentedStart = OctreeRenderer.InputTime;
+		OctreeRenderer.StepsPerRay = CPURenderer.StepsPerRay;
+		OctreeRenderer.RayCount = SDL_AtomicGet(&CPURenderer.Rays);
+		FrameProfile profile = OctreeRenderer.PendingProfiles[0];
+		profile.GPUTime = CPURenderer.RenderTime;
+		profile.Stages[ProfileStageTrace] = CPURenderer.RenderTime;
+		RecordProfile(profile);
+		OctreeRenderer.HistoryValid = false;
+		ResetDirtyRegion();
+		return;
+	}
+	if (!OctreeRenderer.GLEvents && !OctreeRenderer.Headless) { glFinish(); }
+	UpdateRenderScale();
+	int current = OctreeRenderer.OutputIndex;
+	OctreeRenderer.OutputTexture = OctreeRenderer.OutputTextures[current];
+	OctreeRenderer.FrameStarts[current] = OctreeRenderer.InputTime != 0 ? OctreeRenderer.InputTime : TimeNano();
+	bool isUnderWater = EntityIsUnderWater(player);
+	bool persistent = OctreeRenderer.Pipeline == RenderPipelinePersistent;
+	bool heatmap = OctreeRenderer.CounterBuffer != NULL && OctreeRendererHeatmapSupported();
+	bool split = ListCount(OctreeRenderer.SplitDevices) > 1 && OctreeRenderer.Pipeline == RenderPipelineMegakernel && !heatmap;
+	bool temporal = OctreeRenderer.TemporalReprojection && OctreeRenderer.Pipeline != RenderPipelineWavefront && !split;
+	bool hints = temporal && OctreeRenderer.HistoryValid && !isUnderWater;
+	bool checkerboard = OctreeRenderer.Checkerboard && OctreeRenderer.Pipeline != RenderPipelineWavefront && !split && !heatmap;
+	int parity = checkerboard ? OctreeRenderer.FrameIndex++ & 1 : -1;
+	TraceVariant variant = isUnderWater ? TraceVariantUnderWater : TraceVariantAboveWater;
+	cl_kernel kernel = (persistent ? OctreeRenderer.PersistentKernels : OctreeRenderer.Kernels)[variant];
+	cl_mem depths = temporal || checkerboard ? OctreeRenderer.DepthBuffer : NULL;
+	cl_mem stats = OctreeRenderer.CollectStatistics ? OctreeRenderer.StatisticsBuffer : NULL;
+	if (OctreeRenderer.ShadingCaches)
+	{
+		UpdateCloudLayer(pos, time);
+		UpdateSunVisibility(time);
+	}
+	if (OctreeRenderer.GroupSizeTuning && OctreeRenderer.Pipeline == RenderPipelineMegakernel) { RunGroupSizeTuning(kernel, camera, isUnderWater, time); }
+	int error = SetTraceArguments(kernel, OctreeRenderer.RenderImage, OctreeRenderer.TerrainTexture, camera, isUnderWater, time, stats, hints ? OctreeRenderer.HintBuffer : NULL, depths, parity, heatmap ? OctreeRenderer.CounterBuffer : NULL);
+	if (persistent) { error |= clSetKernelArg(kernel, 27, sizeof(cl_mem), &OctreeRenderer.TileCounter); }
 	if (error < 0) { LogFatal("Failed to set kernel argument: %i\n", error); }
-	error = clEnqueueAcquireGLObjects(OctreeRenderer.Queue, 2, (cl_mem[]){ OctreeRenderer.OutputTexture, OctreeRenderer.TerrainTexture }, 0, NULL, NULL);
+	if (persistent)
+	{
+		static const cl_uint zero = 0;
+		error = clEnqueueWriteBuffer(OctreeRenderer.Queue, OctreeRenderer.TileCounter, false, 0, sizeof(zero), &zero, 0, NULL, TrackEvent(ProfileStageUpload));
+		OctreeRenderer.PendingProfiles[current].UploadBytes += sizeof(zero);
+		if (error < 0) { LogFatal("Failed to clear tile counter: %i\n", error); }
+	}
+	if (OctreeRenderer.CollectStatistics)
+	{
+		static const cl_uint zero[RayStatisticCount] = { 0 };
+		error = clEnqueueWriteBuffer(OctreeRenderer.Queue, OctreeRenderer.StatisticsBuffer, false, 0, sizeof(zero), zero, 0, NULL, TrackEvent(ProfileStageUpload));
+		OctreeRenderer.PendingProfiles[current].UploadBytes += sizeof(zero);
+		if (error < 0) { LogFatal("Failed to clear statistics buffer: %i\n", error); }
+	}
+	error = AcquireFrameObjects(current);
 	if (error < 0) { LogFatal("Failed to aquire gl texture: %i\n"); }
-	int groupSize = 50;
+	if (OctreeRenderer.BeamPrepass) { EnqueueBeam(camera, isUnderWater, time); }
+	size_t groupSize[2];
+	KernelGroupSize(kernel, OctreeRenderer.Device, OctreeRenderer.Pipeline == RenderPipelineWavefront ? (size_t[]){ WavefrontGroupSize, WavefrontGroupSize } : OctreeRenderer.GroupSize, groupSize);
 	int w = OctreeRenderer.Width, h = OctreeRenderer.Height;
-	error = clEnqueueNDRangeKernel(OctreeRenderer.Queue, OctreeRenderer.Kernel, 2, NULL, (size_t[]){ w + (groupSize - w % groupSize) % groupSize, h + (groupSize - w % groupSize) % groupSize }, (size_t[]){ groupSize, 1 }, 0, NULL, NULL);
-	if (error < 0) { LogFatal("Failed to enqueue octree renderer: %i\n"); }
-	error = clEnqueueReleaseGLObjects(OctreeRenderer.Queue, 2, (cl_mem[]){ OctreeRenderer.OutputTexture, OctreeRenderer.TerrainTexture }, 0, NULL, NULL);
+	size_t globalSize[] = { w + (groupSize[0] - w % groupSize[0]) % groupSize[0], h + (groupSize[1] - h % groupSize[1]) % groupSize[1] };
+	if (hints) { EnqueueReprojection(camera, globalSize, checkerboard); }
+	if (OctreeRenderer.Pipeline == RenderPipelineWavefront) { EnqueueWavefront(camera, isUnderWater, time, globalSize); }
+	else if (persistent)
+	{
+		error = clEnqueueNDRangeKernel(OctreeRenderer.Queue, kernel, 1, NULL, &OctreeRenderer.PersistentGlobalSize, &OctreeRenderer.PersistentLocalSize, 0, NULL, TrackEvent(ProfileStageTrace));
+		if (error < 0) { LogFatal("Failed to enqueue octree renderer: %i\n", error); }
+	}
+	else if (split) { EnqueueSplitFrame(kernel, variant, camera, isUnderWater, time, globalSize); }
+	else
+	{
+		error = clEnqueueNDRangeKernel(OctreeRenderer.Queue, kernel, 2, NULL, globalSize, groupSize, 0, NULL, TrackEvent(ProfileStageTrace));
+		if (error < 0) { LogFatal("Failed to enqueue octree renderer: %i\n"); }
+	}
+	if (heatmap) { EnqueueHeatmap(globalSize); }
+	cl_mem image = OctreeRenderer.RenderImage;
+	if (checkerboard)
+	{
+		OctreeRenderer.HistoryIndex = !OctreeRenderer.HistoryIndex;
+		EnqueueReconstruction(camera, globalSize, parity);
+		image = OctreeRenderer.HistoryImages[OctreeRenderer.HistoryIndex];
+	}
+	OctreeRenderer.CheckerboardHistory = checkerboard;
+	error = clSetKernelArg(OctreeRenderer.UpscaleKernel, 0, sizeof(cl_mem), &image);
+	error |= clSetKernelArg(OctreeRenderer.UpscaleKernel, 1, sizeof(cl_mem), &OctreeRenderer.OutputTexture);
+	error |= clSetKernelArg(OctreeRenderer.UpscaleKernel, 2, sizeof(int), &OctreeRenderer.FrameWidth);
+	error |= clSetKernelArg(OctreeRenderer.UpscaleKernel, 3, sizeof(int), &OctreeRenderer.FrameHeight);
+	if (error < 0) { LogFatal("Failed to set kernel argument: %i\n", error); }
+	w = OctreeRenderer.FrameWidth, h = OctreeRenderer.FrameHeight;
+	error = clEnqueueNDRangeKernel(OctreeRenderer.Queue, OctreeRenderer.UpscaleKernel, 2, NULL, (size_t[]){ w + (16 - w % 16) % 16, h + (16 - h % 16) % 16 }, (size_t[]){ 16, 16 }, 0, NULL, TrackEvent(ProfileStageUpscale));
+	if (error < 0) { LogFatal("Failed to enqueue upscale: %i\n", error); }
+	bool tracked = OctreeRenderer.CollectStatistics || OctreeRenderer.ProfileLog != NULL;
+	error = ReleaseFrameObjects(tracked ? TrackEvent(ProfileStageRelease) : &OctreeRenderer.FrameEvents[current]);
 	if (error < 0) { LogFatal("Failed to release gl texture: %i\n"); }
+	if (tracked && !OctreeRenderer.CollectStatistics)
+	{
+		error = clEnqueueMarkerWithWaitList(OctreeRenderer.Queue, 0, NULL, &OctreeRenderer.FrameEvents[current]);
+		if (error < 0) { LogFatal("Failed to enqueue marker: %i\n", error); }
+	}
+	if (OctreeRenderer.CollectStatistics)
+	{
+		error = clEnqueueReadBuffer(OctreeRenderer.Queue, OctreeRenderer.StatisticsBuffer, false, 0, sizeof(OctreeRenderer.FrameStatistics[current]), OctreeRenderer.FrameStatistics[current], 0, NULL, &OctreeRenderer.FrameEvents[current]);
+		if (error < 0) { LogFatal("Failed to read statistics buffer: %i\n", error); }
+	}
+	clFlush(OctreeRenderer.Queue);
+	OctreeRenderer.PreviousCamera = camera;
+	OctreeRenderer.HistoryValid = temporal && !isUnderWater;
+	ResetDirtyRegion();
+	
+	int presented = OctreeRenderer.AsyncFrames && OctreeRenderer.FrameEvents[!current] != NULL ? !current : current;
+	FinishFrame(presented);
+	OctreeRenderer.PresentedStart = OctreeRenderer.FrameStarts[presented];
+	OctreeRenderer.TextureID = OctreeRenderer.TextureIDs[presented];
+	OctreeRenderer.OutputIndex = OctreeRenderer.AsyncFrames ? !current : current;
+}
+
+void OctreeRendererFramePresented()
+{
+	if (OctreeRenderer.PresentedStart == 0) { return; }
+	OctreeRenderer.Latency = (TimeNano() - OctreeRenderer.PresentedStart) / 1000000.0;
+	OctreeRenderer.PresentedStart = 0;
+}
+
+void OctreeRendererSetAsyncFrames(bool enabled)
+{
+	OctreeRenderer.AsyncFrames = enabled;
+	if (OctreeRenderer.Queue == NULL) { return; }
 	clFinish(OctreeRenderer.Queue);
+	FinishFrame(0);
+	FinishFrame(1);
 }
 
-void OctreeRendererDeinitialize()
+static void ReleaseCompute()
 {
 	clFinish(OctreeRenderer.Queue);
-	clReleaseMemObject(OctreeRenderer.OutputTexture);
+	ReleaseDistanceField();
+	ReleaseWavefront();
+	ReleaseOutputImages();
+	clReleaseMemObject(OctreeRenderer.RenderImage);
+	clReleaseMemObject(OctreeRenderer.HistoryImages[0]);
+	clReleaseMemObject(OctreeRenderer.HistoryImages[1]);
 	clReleaseMemObject(OctreeRenderer.OctreeBuffer);
-	clReleaseMemObject(OctreeRenderer.BlockBuffer);
+	if (OctreeRenderer.BlockBuffer != NULL) { clReleaseMemObject(OctreeRenderer.BlockBuffer); }
+	ReleaseBrickmap();
+	clReleaseMemObject(OctreeRenderer.HeightBuffer);
+	clReleaseMemObject(OctreeRenderer.SunBuffer);
+	clReleaseMemObject(OctreeRenderer.CloudBuffer);
 	clReleaseMemObject(OctreeRenderer.TerrainTexture);
-	clReleaseKernel(OctreeRenderer.Kernel);
+	clReleaseMemObject(OctreeRenderer.StatisticsBuffer);
+	clReleaseMemObject(OctreeRenderer.MaterialBuffer);
+	clReleaseMemObject(OctreeRenderer.TileCounter);
+	ReleaseBandImages();
+	for (int i = 1; i < ListCount(OctreeRenderer.SplitDevices); i++)
+	{
+		SplitDevice * device = &OctreeRenderer.SplitDevices[i];
+		for (int j = 0; j < TraceVariantCount; j++) { clReleaseKernel(device->Kernels[j]); }
+		clReleaseCommandQueue(device->Queue);
+	}
+	for (int i = 0; i < ListCount(OctreeRenderer.SplitDevices); i++)
+	{
+		if (OctreeRenderer.SplitDevices[i].Event != NULL) { clReleaseEvent(OctreeRenderer.SplitDevices[i].Event); }
+	}
+	ListDestroy(OctreeRenderer.SplitDevices);
+	if (OctreeRenderer.TerrainCopy != NULL) { clReleaseMemObject(OctreeRenderer.TerrainCopy); }
+	ReleaseScreenBuffers();
+	for (int i = 0; i < TraceVariantCount; i++)
+	{
+		clReleaseKernel(OctreeRenderer.Kernels[i]);
+		clReleaseKernel(OctreeRenderer.PersistentKernels[i]);
+	}
+	clReleaseKernel(OctreeRenderer.DistanceKernel);
+	for (int i = 0; i < WavefrontStageCount; i++) { clReleaseKernel(OctreeRenderer.WavefrontKernels[i]); }
+	clReleaseKernel(OctreeRenderer.BeamKernel);
+	clReleaseKernel(OctreeRenderer.ReprojectKernel);
+	clReleaseKernel(OctreeRenderer.UpscaleKernel);
+	clReleaseKernel(OctreeRenderer.ReconstructKernel);
+	clReleaseKernel(OctreeRenderer.SunKernel);
+	clReleaseKernel(OctreeRenderer.CloudKernel);
+	clReleaseKernel(OctreeRenderer.HeatmapKernel);
 	clReleaseCommandQueue(OctreeRenderer.Queue);
 	clReleaseProgram(OctreeRenderer.Shader);
+	for (int i = 0; i < TraceVariantCount; i++) { clReleaseProgram(OctreeRenderer.TraceShaders[i]); }
 	clReleaseContext(OctreeRenderer.Context);
 	clReleaseDevice(OctreeRenderer.Device);
+}
+
+void OctreeRendererDeinitialize()
+{
+	if (!OctreeRenderer.Headless) { CPURendererDeinitialize(); }
+	if (OctreeRenderer.Context != NULL) { ReleaseCompute(); }
+	ListDestroy(OctreeRenderer.FreeBricks);
+	for (int i = 0; i < DirtyBufferCount; i++) { ListDestroy(OctreeRenderer.DirtyRanges[i]); }
+	ListDestroy(OctreeRenderer.DirtyTiles);
+	for (int i = 0; i < 2; i++) { ListDestroy(OctreeRenderer.PendingEvents[i]); }
+	if (OctreeRenderer.ProfileLog != NULL) { SDL_RWclose(OctreeRenderer.ProfileLog); }
+	if (OctreeRenderer.BlockMirror != NULL) { MemoryFree(OctreeRenderer.BlockMirror); }
+	if (OctreeRenderer.ColumnHeights != NULL) { MemoryFree(OctreeRenderer.ColumnHeights); }
 	OctreeRenderer = (struct OctreeRenderer){ 0 };
 }
@@ -1,26 +1,237 @@
 #pragma once
+#include <SDL2/SDL.h>
 #include <OpenCL.h>
 #include "../Level/Octree.h"
+#include "../Utilities/List.h"
 #include "../Utilities/LinearMath.h"
 
+typedef enum TraversalMode
+{
+	TraversalModeGrid,
+	TraversalModeOctree,
+	TraversalModeDistanceField,
+	TraversalModeCount,
+} TraversalMode;
+
+typedef enum BlockStorage
+{
+	BlockStorageDense,
+	BlockStorageBrickmap,
+	BlockStorageMorton,
+	BlockStorageCount,
+} BlockStorage;
+
+typedef enum RenderPipeline
+{
+	RenderPipelineMegakernel,
+	RenderPipelineWavefront,
+	RenderPipelinePersistent,
+	RenderPipelineCPU,
+	RenderPipelineCount,
+} RenderPipeline;
+
+typedef enum RayHeatmap
+{
+	RayHeatmapOff,
+	RayHeatmapSteps,
+	RayHeatmapLayers,
+	RayHeatmapShadowSteps,
+	RayHeatmapReflectionSteps,
+	RayHeatmapCount,
+} RayHeatmap;
+
+typedef enum RayStatistic
+{
+	RayStatisticSteps,
+	RayStatisticRays,
+	RayStatisticLayers,
+	RayStatisticShadowSteps,
+	RayStatisticReflectionSteps,
+	RayStatisticCount,
+} RayStatistic;
+
+typedef enum TraceVariant
+{
+	TraceVariantAboveWater,
+	TraceVariantUnderWater,
+	TraceVariantCount,
+} TraceVariant;
+
+typedef enum DirtyBuffer
+{
+	DirtyBufferOctree,
+	DirtyBufferBlocks,
+	DirtyBufferBricks,
+	DirtyBufferBrickPool,
+	DirtyBufferHeights,
+	DirtyBufferCount,
+} DirtyBuffer;
+
+typedef struct DirtyRange
+{
+	int Start, End;
+} DirtyRange;
+
+typedef struct SplitDevice
+{
+	cl_device_id Device;
+	cl_command_queue Queue;
+	cl_kernel Kernels[TraceVariantCount];
+	cl_mem BandImage;
+	int BandHeight;
+	cl_event Event;
+	int Start, End;
+	float Share;
+} SplitDevice;
+
+typedef enum ProfileStage
+{
+	ProfileStageUpload,
+	ProfileStageAcquire,
+	ProfileStageTrace,
+	ProfileStageUpscale,
+	ProfileStageRelease,
+	ProfileStageCount,
+} ProfileStage;
+
+typedef struct ProfileEvent
+{
+	ProfileStage Stage;
+	cl_event Event;
+} ProfileEvent;
+
+typedef struct FrameProfile
+{
+	float GPUTime, TickTime;
+	float Stages[ProfileStageCount];
+	int UploadBytes;
+} FrameProfile;
+
+#define ProfileWindow 120
+
+typedef enum WavefrontStage
+{
+	WavefrontStageGenerate,
+	WavefrontStageExtend,
+	WavefrontStageShade,
+	WavefrontStageShadow,
+	WavefrontStageReflect,
+	WavefrontStageResolve,
+	WavefrontStageCount,
+} WavefrontStage;
+
 struct OctreeRenderer
 {
 	int Width, Height;
+	int FrameWidth, FrameHeight;
+	float RenderScale, TargetFrameTime, FrameTime;
+	bool DynamicResolution;
+	int ScaleCooldown;
+	uint64_t LastFrame;
 	cl_device_id Device;
 	cl_context Context;
 	cl_program Shader;
-	cl_kernel Kernel;
+	cl_program TraceShaders[TraceVariantCount];
+	cl_kernel Kernels[TraceVariantCount];
+	cl_kernel PersistentKernels[TraceVariantCount];
+	cl_mem TileCounter;
+	list(SplitDevice) SplitDevices;
+	cl_mem TerrainCopy;
+	bool TerrainDirty;
+	size_t PersistentGlobalSize, PersistentLocalSize;
+	cl_kernel DistanceKernel;
+	cl_kernel WavefrontKernels[WavefrontStageCount];
+	cl_kernel BeamKernel;
+	cl_kernel ReprojectKernel;
+	cl_kernel UpscaleKernel;
+	cl_kernel ReconstructKernel;
+	cl_kernel SunKernel;
+	cl_kernel CloudKernel;
+	cl_kernel HeatmapKernel;
 	cl_command_queue Queue;
-	cl_mem OctreeBuffer, BlockBuffer;
-	cl_mem OutputTexture;
+	cl_mem OctreeBuffer, BlockBuffer, HeightBuffer;
+	cl_mem DistanceBuffer, DistanceScratchBuffer, DistanceRepairBuffers[2];
+	cl_mem BrickBuffer, BrickPoolBuffer;
+	cl_mem SunBuffer;
+	bool SunRebuild;
+	cl_mem CloudBuffer;
+	float CloudTime;
+	float2 CloudCenter;
+	cl_mem PathBuffer, PathQueues[2], ShadeQueue, ShadowQueue, ReflectQueue, QueueCounters;
+	cl_mem OutputTexture, RenderImage;
+	cl_mem OutputTextures[2];
+	unsigned int TextureIDs[2];
+	int OutputIndex;
+	bool AsyncFrames, GLEvents, Headless;
+	size_t GroupSize[2];
+	bool GroupSizeTuning;
+	uint64_t GroupSizeKey;
+	char GroupSizePath[1024];
+	cl_event AcquireEvents[2], FrameEvents[2];
+	uint64_t FrameStarts[2], InputTime, PresentedStart;
+	cl_uint FrameStatistics[2][RayStatisticCount];
+	float Latency;
+	cl_mem HistoryImages[2];
+	int HistoryIndex, FrameIndex;
+	bool Checkerboard, CheckerboardHistory;
 	cl_mem TerrainTexture;
+	cl_mem StatisticsBuffer;
+	cl_mem MaterialBuffer;
+	cl_mem StartBuffer;
+	bool BeamPrepass;
+	cl_mem DepthBuffer, HintBuffer;
+	cl_mem CounterBuffer;
+	RayHeatmap Heatmap;
+	bool TemporalReprojection, HistoryValid;
+	bool ShadingCaches;
+	Matrix4x4 PreviousCamera;
+	float3 DirtyMin, DirtyMax;
+	bool CollectStatistics;
+	float StepsPerRay;
+	unsigned int RayCount;
+	cl_uint Statistics[RayStatisticCount];
+	float KernelTime;
+	float StageTimes[WavefrontStageCount];
+	float TickTime;
+	FrameProfile PendingProfiles[2];
+	list(ProfileEvent) PendingEvents[2];
+	FrameProfile Profiles[ProfileWindow];
+	int ProfileCount;
+	SDL_RWops * ProfileLog;
+	RenderPipeline Pipeline;
 	unsigned int TextureID;
+	unsigned int TerrainID;
+	unsigned char * ColumnHeights;
+	TraversalMode TraversalMode;
+	BlockStorage Storage;
+	unsigned int * Bricks;
+	int BrickCount, BrickCapacity;
+	list(int) FreeBricks;
+	unsigned char * BrickPool;
+	unsigned char * BlockMirror;
+	list(DirtyRange) DirtyRanges[DirtyBufferCount];
+	list(int3) DirtyTiles;
 	Octree Octree;
 	TextureManager TextureManager;
 } extern OctreeRenderer;
 
-void OctreeRendererInitialize(TextureManager textures, int width, int height);
+void OctreeRendererInitialize(TextureManager textures, int width, int height, BlockStorage storage, const char * cacheDirectory);
 void OctreeRendererResize(int width, int height);
 void OctreeRendererSetOctree(Octree tree);
+void OctreeRendererUpdateTile(int x, int y, int z, BlockType tile);
+void OctreeRendererMarkDirty(DirtyBuffer buffer, int start, int size);
+void OctreeRendererSetTraversalMode(TraversalMode mode);
+void OctreeRendererSetBlockStorage(BlockStorage storage);
+void OctreeRendererSetPipeline(RenderPipeline pipeline);
+void OctreeRendererSetDynamicResolution(bool enabled);
+void OctreeRendererSetCheckerboard(bool enabled);
+void OctreeRendererSetAsyncFrames(bool enabled);
+void OctreeRendererSetHeatmap(RayHeatmap heatmap);
+bool OctreeRendererHeatmapSupported(void);
+void OctreeRendererTuneGroupSize(void);
+FrameProfile OctreeRendererAverageProfile(void);
+void OctreeRendererToggleProfileLog(const char * directory);
+void OctreeRendererSetShadingCaches(bool enabled);
 void OctreeRendererEnqueue(float dt, float time, bool doBobbing);
+void OctreeRendererFramePresented();
 void OctreeRendererDeinitialize(void);
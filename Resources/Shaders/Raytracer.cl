@@ -1,28 +1,110 @@
 #define BlockTypeNone 0
-#define BlockTypeGrass 2
-#define BlockTypeSapling 6
 #define BlockTypeBedrock 7
 #define BlockTypeWater 8
 #define BlockTypeStillWater 9
-#define BlockTypeLog 17
-#define BlockTypeLeaves 18
-#define BlockTypeGlass 20
-#define BlockTypeDandelion 37
-#define BlockTypeRose 38
-#define BlockTypeBrownMushroom 39
-#define BlockTypeRedMushroom 40
-#define BlockTypeGold 41
-#define BlockTypeIron 42
-#define BlockTypeDoubleSlab 43
-#define BlockTypeSlab 44
-#define BlockTypeTNT 46
-#define BlockTypeBookshelf 47
 #define BlockTypeCloud 50
 #define Epsilon 0.0001f
+#define TraversalModeGrid 0
+#define TraversalModeOctree 1
+#define TraversalModeDistanceField 2
+#define DistanceFieldMax 15
+#define BlockStorageDense 0
+#define BlockStorageBrickmap 1
+#define BlockStorageMorton 2
+#define BrickUniform 0x80000000u
+#define BlockShapeCube 0
+#define BlockShapeSlab 1
+#define BlockShapeCross 2
+#define BlockShapeLiquid 3
+#define BlockAlphaBlend 0
+#define BlockAlphaCutout 1
+#define BlockAlphaMerged 2
+#define TextureMissing 255
+#define BeamTileSize 8
+#define PersistentTileSize 8
+#define TemporalMargin 1.5f
+#define TemporalAgreement 3.0f
+#define CameraFocalLength (0.5f / tanpi(70.0f / 360.0f))
+#define UpscaleEdgeSharpness 32.0f
+#define CloudHeight 256.0f
+#define CloudLayerSize 1024
+#define CloudTexelSize 2.0f
+#define CloudBakeMargin 24.0f
+#define SunEntries 4
+#define SunEntryCenter 3
+#define LightDirection normalize((float3){ 1.0f, 1.0f, 0.5f })
+#ifndef LEVEL_HEIGHT
+#define LEVEL_HEIGHT 64
+#endif
+#ifdef UNDERWATER
+#define UnderWater(flag) UNDERWATER
+#else
+#define UnderWater(flag) (flag)
+#endif
+#define WorldParameters uint treeDepth, __global uchar * octree, __global uchar * blocks, __global uint * bricks, __global uchar * brickPool, int storage, __global uchar * heights, __global uchar * distances, int traversalMode, __read_only image2d_t terrain, float time, __global uint * stats, __global uchar4 * sun, __global float * clouds, __constant BlockMaterial * materials
+#define WorldArguments { .treeDepth = treeDepth, .levelSize = 1 << treeDepth, .octree = octree, .blocks = blocks, .bricks = bricks, .brickPool = brickPool, .storage = storage, .heights = heights, .distances = distances, .traversalMode = traversalMode, .sun = sun, .clouds = clouds, .materials = materials, .steps = 0, .rays = 0, .layers = 0, .shadowSteps = 0, .reflectSteps = 0 }
 
-const sampler_t TerrainSampler = CLK_NORMALIZED_COORDS_TRUE | CLK_ADDRESS_REPEAT | CLK_FILTER_NEAREST;
+typedef struct BlockMaterial
+{
+	uchar faces[6];
+	uchar shape;
+	uchar alpha;
+	float reflectiveness;
+} BlockMaterial;
+
+typedef struct World
+{
+	uint treeDepth;
+	int levelSize;
+	__global uchar * octree;
+	__global uchar * blocks;
+	__global uint * bricks;
+	__global uchar * brickPool;
+	int storage;
+	__global uchar * heights;
+	__global uchar * distances;
+	int traversalMode;
+	__global uchar4 * sun;
+	__global float * clouds;
+	__constant BlockMaterial * materials;
+	uint steps;
+	uint rays;
+	uint layers;
+	uint shadowSteps;
+	uint reflectSteps;
+} World;
+
+typedef struct Path
+{
+	float4 origin;
+	float4 ray;
+	float4 exit;
+	float4 water;
+	float4 color;
+	float4 hit;
+	float4 normal;
+	float4 shade;
+	float4 incident;
+	float4 entry;
+	float4 traversal;
+	int4 voxel;
+} Path;
 
-constant int TextureIDTable[256] = { 0, 2, 0, 3, 17, 5, 16, 17, 15, 15, 31, 31, 19, 20, 33, 34, 35, 0, 23, 49, 50, 65, 66, 67, 68, 69, 70, 71, 72, 73, 74, 75, 76, 77, 78, 79, 80, 14, 13, 30, 29, 41, 40, 0, 0, 8, 0, 0, 37, 38 };
+typedef struct Traversal
+{
+	float3 ray;
+	float3 origin;
+	float3 inv;
+	float3 delta;
+	float3 next;
+	int3 step;
+	int3 voxel;
+	float enter;
+	int axis;
+} Traversal;
+
+const sampler_t TerrainSampler = CLK_NORMALIZED_COORDS_TRUE | CLK_ADDRESS_REPEAT | CLK_FILTER_NEAREST;
+const sampler_t PixelSampler = CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_CLAMP_TO_EDGE | CLK_FILTER_NEAREST;
 
 float3 MatrixTransformPoint(float16 l, float3 r)
 {
@@ -99,32 +181,27 @@ float3 CloudNormal(float3 p, float time)
 	return normalize((float3){ CloudSDF(p + h.xyy, time) - CloudSDF(p - h.xyy, time), CloudSDF(p + h.yxy, time) - CloudSDF(p - h.yxy, time), CloudSDF(p + h.yyx, time) - CloudSDF(p - h.yyx, time) });
 }
 
-int GetTextureID(uchar tile, int side)
+bool CloudClear(__global float * clouds, float3 p, float time)
 {
-	if (tile == BlockTypeGrass) { return side == 1 ? 0 : (side == 0 ? 2 : 3); }
-	if (tile == BlockTypeLog) { return side == 1 ? 21 : (side == 0 ? 21 : 20); }
-	if (tile == BlockTypeSlab || tile == BlockTypeDoubleSlab) { return side <= 1 ? 6 : 5; }
-	if (tile == BlockTypeBookshelf) { return side <= 1 ? 4 : 35; }
-	if (tile == BlockTypeGold || tile == BlockTypeIron) { return side == 1 ? TextureIDTable[tile] - 17 : (side == 0 ? TextureIDTable[tile] + 15 : TextureIDTable[tile] - 1); }
-	if (tile == BlockTypeTNT) { return side == 0 ? 10 : (side == 1 ? 9 : 8); }
-	return TextureIDTable[tile] - 1;
+	if (clouds == NULL || clouds[2] != time) { return false; }
+	float2 uv = (p.xz - (float2){ clouds[0], clouds[1] }) / CloudTexelSize - 0.5f;
+	if (any(uv < 0.0f) || any(uv >= CloudLayerSize - 1.0f)) { return false; }
+	__global float * texel = clouds + 4 + (int)uv.y * CloudLayerSize + (int)uv.x;
+	return fmin(fmin(texel[0], texel[1]), fmin(texel[CloudLayerSize], texel[CloudLayerSize + 1])) > CloudBakeMargin;
 }
 
-float GetTileReflectiveness(uchar tile, float4 color)
+float GetTileReflectiveness(__constant BlockMaterial * materials, uchar tile, float4 color)
 {
-	if (tile == BlockTypeGlass && color.w == 0.0f) { return 0.25f; }
-	if (tile == BlockTypeWater || tile == BlockTypeStillWater) { return 0.25f; }
+#ifdef ENABLE_REFLECTIONS
+	BlockMaterial material = materials[tile];
+	if (material.alpha != BlockAlphaMerged || color.w == 0.0f) { return material.reflectiveness; }
+#endif
 	return 0.0f;
 }
 
-bool HasCrossPlaneCollision(uchar tile)
+bool HasCrossPlaneCollision(World * world, uchar tile)
 {
-	return tile == BlockTypeSapling || tile == BlockTypeDandelion || tile == BlockTypeRose || tile == BlockTypeRedMushroom || tile == BlockTypeBrownMushroom;
-}
-
-bool ShouldDiscardTransparency(uchar tile)
-{
-	return tile == BlockTypeLeaves || HasCrossPlaneCollision(tile);
+	return world->materials[tile].shape == BlockShapeCross;
 }
 
 float3 BGColor(float3 ray)
@@ -141,19 +218,74 @@ float4 WaterColor(float3 hit, __read_only image2d_t terrain)
 
 bool PointInBounds(int3 v, int levelSize)
 {
-	return v.x >= 0 && v.y >= 0 && v.z >= 0 && v.x < levelSize && v.y < 64 && v.z < levelSize;
+	return v.x >= 0 && v.y >= 0 && v.z >= 0 && v.x < levelSize && v.y < LEVEL_HEIGHT && v.z < levelSize;
+}
+
+uint GetBrick(World * world, int3 v)
+{
+	int bricksPerRow = world->levelSize >> 3;
+	return world->bricks[((v.y >> 3) * bricksPerRow + (v.z >> 3)) * bricksPerRow + (v.x >> 3)];
+}
+
+uint MortonSpread(uint v)
+{
+	v = (v | (v << 8)) & 0x0300f00fu;
+	v = (v | (v << 4)) & 0x030c30c3u;
+	return (v | (v << 2)) & 0x09249249u;
 }
 
-bool RayBlockIntersection(__global uchar * blocks, __read_only image2d_t terrain, float3 ray, float3 origin, int levelSize, bool ignoreWater, float time, int3 voxel, uchar tile, float3 hitExit, float3 * hit, float3 * normal, float4 * color)
+uint MortonIndex(int3 v, int levelSize)
+{
+	uint local = MortonSpread(v.x & 63) | (MortonSpread(v.y) << 1) | (MortonSpread(v.z & 63) << 2);
+	return ((uint)((v.z >> 6) * (levelSize >> 6) + (v.x >> 6)) << 18) | local;
+}
+
+uchar GetBlock(World * world, int3 v)
+{
+	if (world->storage == BlockStorageMorton) { return world->blocks[MortonIndex(v, world->levelSize)]; }
+	if (world->storage == BlockStorageBrickmap)
+	{
+		uint brick = GetBrick(world, v);
+		if (brick & BrickUniform) { return brick & 0xff; }
+		return world->brickPool[(brick << 9) + (((v.y & 7) << 6) | ((v.z & 7) << 3) | (v.x & 7))];
+	}
+	return world->blocks[(v.y * world->levelSize + v.z) * world->levelSize + v.x];
+}
+
+int OctreeEmptyNode(World * world, int3 voxel, int3 * nodeMin)
+{
+	int start = 0, offset = 0, levelCount = 1;
+	int3 base = (int3){ 0, 0, 0 };
+	int mid = world->levelSize / 2;
+	for (uint i = 0; i < world->treeDepth; i++)
+	{
+		int3 q = (int3){ voxel.x >= base.x + mid, voxel.y >= base.y + mid, voxel.z >= base.z + mid };
+		uchar mask = world->octree[start + offset];
+		int child = q.x + 2 * q.y + 4 * q.z;
+		base += mid * q;
+		if (((mask >> child) & 1) == 0)
+		{
+			*nodeMin = base;
+			return mid;
+		}
+		offset = 8 * offset + child;
+		start += levelCount;
+		levelCount *= 8;
+		mid /= 2;
+	}
+	return 0;
+}
+
+bool RayBlockIntersection(World * world, __read_only image2d_t terrain, float3 ray, float3 origin, bool ignoreWater, float time, int3 voxel, uchar tile, float3 hitExit, float3 * hit, float3 * normal, float4 * color)
 {
 	float3 base = convert_float3(voxel);
 	float3 dim = (float3){ 1.0f, 1.0f, 1.0f };
+	BlockMaterial material = world->materials[tile];
 	if (tile == BlockTypeNone) { return false; }
-	else if (tile == BlockTypeWater || tile == BlockTypeStillWater)
+	else if (material.shape == BlockShapeLiquid)
 	{
 		if (ignoreWater) { return false; }
-		*normal = BoxNormal(*hit, base, base + 1.0f);
-		uchar above = blocks[((voxel.y + 1) * levelSize + voxel.z) * levelSize + voxel.x];
+		uchar above = PointInBounds(voxel + (int3){ 0, 1, 0 }, world->levelSize) ? GetBlock(world, voxel + (int3){ 0, 1, 0 }) : BlockTypeNone;
 		if (above != BlockTypeWater && above != BlockTypeStillWater)
 		{
 			float amp = 0.05f;
@@ -166,7 +298,7 @@ bool RayBlockIntersection(__global uchar * blocks, __read_only image2d_t terrain
 			if (fabs(hit->y - base.y - dim.y) < Epsilon) { *normal = normalize((float3){ 0.5f * amp * freq * cos((hit->x + hit->z) * freq + time), 1.0f, 0.5f * amp * freq * cos((hit->x + hit->z) * freq + time) }); }
 		}
 	}
-	else if (tile == BlockTypeSlab)
+	else if (material.shape == BlockShapeSlab)
 	{
 		dim.y = 0.5f;
 		float enter, exit;
@@ -175,14 +307,13 @@ bool RayBlockIntersection(__global uchar * blocks, __read_only image2d_t terrain
 		if (!((exit > enter && enter > 0.0f) || (exit > 0.0f && enter < 0.0f))) { return false; }
 		*normal = BoxNormal(*hit, base, base + dim);
 	}
-	else if (tile == BlockTypeGlass)
+	else if (material.alpha == BlockAlphaMerged)
 	{
 		int3 prevVoxel = convert_int3(*hit - sign(ray) * Epsilon);
-		uchar prev = blocks[(prevVoxel.y * levelSize + prevVoxel.z) * levelSize + prevVoxel.x];
-		if (prev == BlockTypeGlass) { return false; }
-		*normal = BoxNormal(*hit, base, base + 1.0f);
+		uchar prev = PointInBounds(prevVoxel, world->levelSize) ? GetBlock(world, prevVoxel) : BlockTypeNone;
+		if (prev == tile) { return false; }
 	}
-	else if (HasCrossPlaneCollision(tile))
+	else if (material.shape == BlockShapeCross)
 	{
 		float p1Dist;
 		float3 p1Hit, p1Normal;
@@ -205,7 +336,7 @@ bool RayBlockIntersection(__global uchar * blocks, __read_only image2d_t terrain
 			p1Normal = (float3){ 1.0f, 0.0f, 1.0f } * (1.0f - hit->z + base.z > hit->x - base.x ? -1.0f : 1.0f);
 			p1Hit = *hit + ray * p1Dist;
 			float2 uv = { distance(base.xz + (float2){ 0.1464466f, 1.0f - 0.1464466f }, p1Hit.xz), 1.0f - (p1Hit.y - base.y) };
-			int id = GetTextureID(tile, 0);
+			int id = material.faces[0];
 			uv = uv / 16.0f + (float2){ (float)((id % 16) << 4), (float)((id / 16) << 4) } / 256.0f;
 			p1Color = read_imagef(terrain, TerrainSampler, uv);
 			if (p1Color.w == 0.0f) { p1Intersect = false; }
@@ -216,7 +347,7 @@ bool RayBlockIntersection(__global uchar * blocks, __read_only image2d_t terrain
 			p2Normal = (float3){ 1.0f, 0.0f, -1.0f } * (hit->z - base.z > hit->x - base.x ? -1.0f : 1.0f);
 			p2Hit = *hit + ray * p2Dist;
 			float2 uv = { 1.0f - distance(base.xz + (float2){ 0.1464466f, 0.1464466f }, p2Hit.xz), 1.0f - (p2Hit.y - base.y) };
-			int id = GetTextureID(tile, 0);
+			int id = material.faces[0];
 			uv = uv / 16.0f + (float2){ (float)((id % 16) << 4), (float)((id / 16) << 4) } / 256.0f;
 			p2Color = read_imagef(terrain, TerrainSampler, uv);
 			if (p2Color.w == 0.0f) { p2Intersect = false; }
@@ -239,10 +370,6 @@ bool RayBlockIntersection(__global uchar * blocks, __read_only image2d_t terrain
 		}
 		return false;
 	}
-	else
-	{
-		*normal = BoxNormal(*hit, base, base + 1.0f);
-	}
 	
 	float2 uv = (float2){ 0.0f, 0.0f };
 	float3 n = *hit - base;
@@ -253,47 +380,189 @@ bool RayBlockIntersection(__global uchar * blocks, __read_only image2d_t terrain
 	if (fabs(n.y - dim.y) < Epsilon) { uv = n.xz; side = 1; }
 	if (fabs(n.z) < Epsilon) { uv = (float2){ 1.0f - n.x, 1.0f - n.y }; side = 3; }
 	if (fabs(n.z - dim.z) < Epsilon) { uv = (float2){ n.x, 1.0f - n.y }; side = 2; }
-	int id = GetTextureID(tile, side);
-	if (id == -1) { *color = (float4){ 1.0f, 0.0f, 1.0f, 1.0f }; return true; }
-	if (id == -2) { return false; }
+	int id = material.faces[side];
+	if (id == TextureMissing) { *color = (float4){ 1.0f, 0.0f, 1.0f, 1.0f }; return true; }
 	uv = uv / 16.0f + (float2){ (float)((id % 16) << 4), (float)((id / 16) << 4) } / 256.0f;
 	*color = read_imagef(terrain, TerrainSampler, uv);
-	if (ShouldDiscardTransparency(tile) && color->w == 0.0f) { return false; }
-	if (tile == BlockTypeWater || tile == BlockTypeStillWater) { hit->y += 0.1f; }
+	if (material.alpha == BlockAlphaCutout && color->w == 0.0f) { return false; }
+	if (material.shape == BlockShapeLiquid) { hit->y += 0.1f; }
 	return true;
 }
 
-bool RayWorldIntersection(__global uchar * blocks, __read_only image2d_t terrain, float3 ray, float3 origin, int levelSize, bool ignoreWater, float time, int3 * voxel, float3 * hit, float3 * hitExit, uchar * tile, float3 * normal, float4 * color)
+void TraversalSetVoxel(Traversal * t, int3 voxel, float enter, int axis)
 {
-	*voxel = convert_int3(origin);
-	*hitExit = origin;
-	while (PointInBounds(*voxel, levelSize))
+	float3 boundary = convert_float3(voxel + select((int3){ 0, 0, 0 }, (int3){ 1, 1, 1 }, t->step > 0));
+	t->voxel = voxel;
+	t->next = select((float3){ INFINITY, INFINITY, INFINITY }, (boundary - t->origin) * t->inv, t->step != 0);
+	t->enter = enter;
+	t->axis = axis;
+}
+
+void TraversalInit(Traversal * t, float3 ray, float3 origin)
+{
+	t->ray = ray;
+	t->origin = origin;
+	t->inv = 1.0f / ray;
+	t->delta = fabs(t->inv);
+	t->step = convert_int3(sign(ray));
+}
+
+void TraversalBegin(Traversal * t, float3 ray, float3 origin)
+{
+	TraversalInit(t, ray, origin);
+	int3 voxel = convert_int3(floor(origin));
+	float3 base = convert_float3(voxel);
+	float3 tn = select((float3){ -INFINITY, -INFINITY, -INFINITY }, fmin((base - origin) * t->inv, (base + 1.0f - origin) * t->inv), t->step != 0);
+	int axis = tn.x >= tn.y && tn.x >= tn.z ? 0 : (tn.y >= tn.z ? 1 : 2);
+	TraversalSetVoxel(t, voxel, fmax(tn.x, fmax(tn.y, tn.z)), axis);
+}
+
+void TraversalResume(Traversal * t, float3 ray, float4 origin, int4 voxel)
+{
+	TraversalInit(t, ray, origin.xyz);
+	TraversalSetVoxel(t, voxel.xyz, origin.w, voxel.w);
+}
+
+float TraversalExit(Traversal * t)
+{
+	return fmin(t->next.x, fmin(t->next.y, t->next.z));
+}
+
+float3 TraversalNormal(Traversal * t)
+{
+	if (t->axis == 0) { return (float3){ (float)-t->step.x, 0.0f, 0.0f }; }
+	if (t->axis == 1) { return (float3){ 0.0f, (float)-t->step.y, 0.0f }; }
+	return (float3){ 0.0f, 0.0f, (float)-t->step.z };
+}
+
+void TraversalStep(Traversal * t)
+{
+	if (t->next.x < t->next.y && t->next.x < t->next.z)
 	{
-		*tile = blocks[(voxel->y * levelSize + voxel->z) * levelSize + voxel->x];
-		float enter, exit;
-		RayBox(ray, origin, floor(*hitExit), floor(*hitExit) + 1.0f, &enter, &exit);
-		*hit = origin + ray * (HasCrossPlaneCollision(*tile) ? fmax(enter, 0.0f) : enter);
-		*hitExit = origin + ray * exit + sign(ray) * Epsilon;
+		t->enter = t->next.x;
+		t->next.x += t->delta.x;
+		t->voxel.x += t->step.x;
+		t->axis = 0;
+	}
+	else if (t->next.y < t->next.z)
+	{
+		t->enter = t->next.y;
+		t->next.y += t->delta.y;
+		t->voxel.y += t->step.y;
+		t->axis = 1;
+	}
+	else
+	{
+		t->enter = t->next.z;
+		t->next.z += t->delta.z;
+		t->voxel.z += t->step.z;
+		t->axis = 2;
+	}
+}
+
+float3 TraversalBoxExit(Traversal * t, int3 bmin, int3 bmax)
+{
+	float3 boundary = convert_float3(select(bmin, bmax, t->step > 0));
+	return select((float3){ INFINITY, INFINITY, INFINITY }, (boundary - t->origin) * t->inv, t->step != 0);
+}
+
+void TraversalSkip(Traversal * t, int3 bmin, int3 bmax)
+{
+	float3 exit = TraversalBoxExit(t, bmin, bmax);
+	int axis = exit.x < exit.y && exit.x < exit.z ? 0 : (exit.y < exit.z ? 1 : 2);
+	float enter = fmin(exit.x, fmin(exit.y, exit.z));
+	int3 voxel = clamp(convert_int3(floor(t->origin + t->ray * enter)), bmin, bmax - 1);
+	if (axis == 0) { voxel.x = t->step.x > 0 ? bmax.x : bmin.x - 1; }
+	if (axis == 1) { voxel.y = t->step.y > 0 ? bmax.y : bmin.y - 1; }
+	if (axis == 2) { voxel.z = t->step.z > 0 ? bmax.z : bmin.z - 1; }
+	TraversalSetVoxel(t, voxel, enter, axis);
+}
+
+void TraversalFarthestExit(Traversal * t, int3 emptyMin, int3 emptyMax, float * farthest, int3 * farthestMin, int3 * farthestMax)
+{
+	if (any(emptyMax <= emptyMin)) { return; }
+	float3 exit = TraversalBoxExit(t, emptyMin, emptyMax);
+	float dist = fmin(exit.x, fmin(exit.y, exit.z));
+	if (dist > *farthest)
+	{
+		*farthest = dist;
+		*farthestMin = emptyMin;
+		*farthestMax = emptyMax;
+	}
+}
+
+bool SkipEmptySpace(World * world, Traversal * t)
+{
+	if (world->traversalMode == TraversalModeGrid) { return false; }
+	float farthest = TraversalExit(t);
+	int3 farthestMin = t->voxel, farthestMax = t->voxel;
+	if (world->traversalMode == TraversalModeOctree)
+	{
+		int3 nodeMin;
+		int size = OctreeEmptyNode(world, t->voxel, &nodeMin);
+		if (size > 0) { TraversalFarthestExit(t, nodeMin, nodeMin + size, &farthest, &farthestMin, &farthestMax); }
+	}
+	else if (world->traversalMode == TraversalModeDistanceField)
+	{
+		int size = world->distances[(t->voxel.y * world->levelSize + t->voxel.z) * world->levelSize + t->voxel.x];
+		TraversalFarthestExit(t, t->voxel - max(size - 1, 0), t->voxel + size, &farthest, &farthestMin, &farthestMax);
+	}
+	if (world->storage == BlockStorageBrickmap && GetBrick(world, t->voxel) == BrickUniform)
+	{
+		int3 brickMin = t->voxel & ~7;
+		TraversalFarthestExit(t, brickMin, brickMin + 8, &farthest, &farthestMin, &farthestMax);
+	}
+	
+	int height = world->heights[t->voxel.z * world->levelSize + t->voxel.x];
+	if (t->voxel.y >= height) { TraversalFarthestExit(t, (int3){ t->voxel.x, height, t->voxel.z }, (int3){ t->voxel.x + 1, LEVEL_HEIGHT, t->voxel.z + 1 }, &farthest, &farthestMin, &farthestMax); }
+	
+	if (any(farthestMax <= farthestMin)) { return false; }
+	TraversalSkip(t, farthestMin, farthestMax);
+	return true;
+}
+
+bool RayWorldIntersection(World * world, __read_only image2d_t terrain, Traversal * t, bool ignoreWater, float time, int3 * voxel, float3 * hit, float3 * hitExit, uchar * tile, float3 * normal, float4 * color)
+{
+	float3 ray = t->ray, origin = t->origin;
+	if (!PointInBounds(t->voxel, world->levelSize))
+	{
+		*hit = *hitExit;
+		return false;
+	}
+	while (PointInBounds(t->voxel, world->levelSize))
+	{
+		world->steps++;
+		if (SkipEmptySpace(world, t)) { continue; }
+		
+		*voxel = t->voxel;
+		*tile = GetBlock(world, *voxel);
+		*hit = origin + ray * (HasCrossPlaneCollision(world, *tile) ? fmax(t->enter, 0.0f) : t->enter);
+		*hitExit = origin + ray * TraversalExit(t) + sign(ray) * Epsilon;
+		*normal = TraversalNormal(t);
 		
-		if (RayBlockIntersection(blocks, terrain, ray, origin, levelSize, ignoreWater, time, *voxel, *tile, *hitExit, hit, normal, color)) { return true; }
-		*voxel = convert_int3(floor(*hitExit));
+		bool found = RayBlockIntersection(world, terrain, ray, origin, ignoreWater, time, *voxel, *tile, *hitExit, hit, normal, color);
+		TraversalStep(t);
+		if (found) { return true; }
 	}
+	*hit = origin + ray * fmax(t->enter, 0.0f);
+	*hitExit = t->enter > 0.0f ? *hit + sign(ray) * Epsilon : origin;
 	return false;
 }
 
-bool RaySceneIntersection(__global uchar * blocks, __read_only image2d_t terrain, float3 ray, float3 origin, int levelSize, bool ignoreWater, float time, int3 * voxel, float3 * hit, float3 * hitExit, uchar * tile, float3 * normal, float4 * color)
+bool RaySceneIntersection(World * world, __read_only image2d_t terrain, Traversal * t, bool ignoreWater, float time, int3 * voxel, float3 * hit, float3 * hitExit, uchar * tile, float3 * normal, float4 * color)
 {
-	if (!RayWorldIntersection(blocks, terrain, ray, origin, levelSize, ignoreWater, time, voxel, hit, hitExit, tile, normal, color))
+	float3 ray = t->ray, origin = *hitExit;
+	if (!RayWorldIntersection(world, terrain, t, ignoreWater, time, voxel, hit, hitExit, tile, normal, color))
 	{
 		float dist;
-		float cloudHeight = 256.0f;
-		if (RayPlaneIntersection(ray, *hitExit, (float3){ 0.0f, -1.0f, 0.0f }, (float3){ 0.0f, cloudHeight, 0.0f }, &dist))
+#ifdef ENABLE_CLOUDS
+		if (RayPlaneIntersection(ray, *hitExit, (float3){ 0.0f, -1.0f, 0.0f }, (float3){ 0.0f, CloudHeight, 0.0f }, &dist))
 		{
 			*hit = *hitExit + ray * dist;
 			float depth = 0.0f;
 			for (int i = 0; i < 1; i++)
 			{
-				float d = CloudSDF(ray * depth + *hit, time);
+				float d = CloudClear(world->clouds, ray * depth + *hit, time) ? INFINITY : CloudSDF(ray * depth + *hit, time);
 				if (d < Epsilon)
 				{
 					*hit = ray * depth + *hit;
@@ -307,6 +576,9 @@ bool RaySceneIntersection(__global uchar * blocks, __read_only image2d_t terrain
 			}
 			return false;
 		}
+#else
+		if (ray.y > Epsilon) { return false; }
+#endif
 		if (!ignoreWater && RayPlaneIntersection(ray, *hitExit, (float3){ 0.0f, 1.0f, 0.0f }, (float3){ 0.0f, 31.9f, 0.0f }, &dist))
 		{
 			*hit = *hitExit + ray * dist;
@@ -342,18 +614,21 @@ float3 TraceLighting(float3 color, float3 lightDir, float3 normal, float3 ray, u
 	return (ambient + diffuse + specular) * color;
 }
 
-float3 TraceShadows(float3 color, float3 lightDir, __global uchar * blocks, __read_only image2d_t terrain, float3 hit, int levelSize, bool inWater, float3 waterEntry, float time, uchar tile)
+float4 ShadowTransmittance(World * world, __read_only image2d_t terrain, float3 lightDir, float3 exit, bool inWater, float3 waterEntry, float time, bool clouds)
 {
+	uint steps = world->steps;
 	float4 shadowColor = { 0.0f, 0.0f, 0.0f, 1.0f };
 	float4 hitColor = { 0.0f, 0.0f, 0.0f, 0.0f };
-	float3 exit = hit + (HasCrossPlaneCollision(tile) ? 0.0f : Epsilon * lightDir);
 	float3 shadowHit, normal;
 	int3 voxel;
-	waterEntry = inWater ? waterEntry : hit;
+	uchar tile = 0;
+	Traversal t;
+	TraversalBegin(&t, lightDir, exit);
 	while (hitColor.w < 1.0f)
 	{
-		if (RaySceneIntersection(blocks, terrain, lightDir, exit, levelSize, inWater, time, &voxel, &shadowHit, &exit, &tile, &normal, &hitColor))
+		if (RaySceneIntersection(world, terrain, &t, inWater, time, &voxel, &shadowHit, &exit, &tile, &normal, &hitColor))
 		{
+			if (!clouds && tile == BlockTypeCloud) { break; }
 			if (inWater)
 			{
 				if (tile == BlockTypeWater || tile == BlockTypeStillWater) { continue; }
@@ -370,7 +645,54 @@ float3 TraceShadows(float3 color, float3 lightDir, __global uchar * blocks, __re
 		}
 		else { break; }
 	}
+	world->shadowSteps += world->steps - steps;
+	return shadowColor;
+}
+
+int SunIndex(World * world, int3 cell)
+{
+	return (cell.y * world->levelSize + cell.z) * world->levelSize + cell.x;
+}
+
+bool SunVisibility(World * world, float3 lightDir, float3 hit, float3 normal, bool inWater, float time, uchar tile, float4 * shadowColor)
+{
+	if (world->sun == NULL || inWater) { return false; }
+	int3 cell;
+	int entry = SunEntryCenter;
+	if (world->materials[tile].shape == BlockShapeCube)
+	{
+		if (dot(normal, lightDir) <= 0.0f) { return false; }
+		cell = convert_int3(floor(hit + normal * 0.5f));
+		entry = normal.x != 0.0f ? 0 : (normal.y != 0.0f ? 1 : 2);
+	}
+	else { cell = convert_int3(floor(hit + normalize(normal) * Epsilon)); }
+	if (!PointInBounds(cell, world->levelSize) && cell.y < LEVEL_HEIGHT) { return false; }
+	*shadowColor = cell.y < LEVEL_HEIGHT ? convert_float4(world->sun[SunIndex(world, cell) * SunEntries + entry]) / 255.0f : (float4){ 0.0f, 0.0f, 0.0f, 1.0f };
+#ifdef ENABLE_CLOUDS
+	float dist;
+	if (RayPlaneIntersection(lightDir, hit, (float3){ 0.0f, -1.0f, 0.0f }, (float3){ 0.0f, CloudHeight, 0.0f }, &dist) && !CloudClear(world->clouds, hit + lightDir * dist, time) && CloudSDF(hit + lightDir * dist, time) < Epsilon)
+	{
+		shadowColor->xyz += 0.05f * shadowColor->w;
+		shadowColor->w *= 0.95f;
+	}
+#endif
+	return true;
+}
+
+float3 TraceShadows(float3 color, float3 lightDir, World * world, __read_only image2d_t terrain, float3 hit, float3 normal, bool inWater, float3 waterEntry, float time, uchar tile)
+{
+#ifdef ENABLE_SHADOWS
+	float4 shadowColor;
+	if (!SunVisibility(world, lightDir, hit, normal, inWater, time, tile, &shadowColor))
+	{
+		world->rays++;
+		float3 exit = hit + (HasCrossPlaneCollision(world, tile) ? 0.0f : Epsilon * lightDir);
+		shadowColor = ShadowTransmittance(world, terrain, lightDir, exit, inWater, inWater ? waterEntry : hit, time, true);
+	}
 	return color * shadowColor.w + (shadowColor.xyz * shadowColor.w + 0.375f * color * (1.0f - shadowColor.w)) * (1.0f - shadowColor.w);
+#else
+	return color;
+#endif
 }
 
 float4 TraceFog(float3 hit, float3 origin, float3 ray)
@@ -380,8 +702,10 @@ float4 TraceFog(float3 hit, float3 origin, float3 ray)
 	return (float4){ BGColor(ray), w };
 }
 
-float3 TraceReflections(float3 normal, __global uchar * blocks, __read_only image2d_t terrain, float3 hit, int levelSize, float3 ray, float3 lightDir, float time)
+float3 TraceReflections(float3 normal, World * world, __read_only image2d_t terrain, float3 hit, float3 ray, float3 lightDir, float time)
 {
+	world->rays++;
+	uint steps = world->steps, shadowSteps = world->shadowSteps;
 	float4 reflectionColor = { 0.0f, 0.0f, 0.0f, 1.0f };
 	float4 hitColor = { 0.0f, 0.0f, 0.0f, 0.0f };
 	float3 rRay = normalize(ray - 2.0f * dot(ray, normal) * normal);
@@ -391,9 +715,11 @@ float3 TraceReflections(float3 normal, __global uchar * blocks, __read_only imag
 	uchar tile = 0;
 	bool inWater = false;
 	float3 waterEntry = hit;
+	Traversal t;
+	TraversalBegin(&t, rRay, exit);
 	while (hitColor.w < 1.0f)
 	{
-		if (RaySceneIntersection(blocks, terrain, rRay, exit, levelSize, inWater, time, &voxel, &rHit, &exit, &tile, &rNormal, &hitColor))
+		if (RaySceneIntersection(world, terrain, &t, inWater, time, &voxel, &rHit, &exit, &tile, &rNormal, &hitColor))
 		{
 			if (inWater)
 			{
@@ -401,7 +727,7 @@ float3 TraceReflections(float3 normal, __global uchar * blocks, __read_only imag
 				else { reflectionColor.w *= (1.0f - min(distance(rHit, waterEntry) / 10.0f, 1.0f)); }
 			}
 			hitColor.xyz = TraceLighting(hitColor.xyz, lightDir, rNormal, ray, tile);
-			hitColor.xyz = TraceShadows(hitColor.xyz, lightDir, blocks, terrain, rHit, levelSize, inWater, waterEntry, time, tile);
+			hitColor.xyz = TraceShadows(hitColor.xyz, lightDir, world, terrain, rHit, rNormal, inWater, waterEntry, time, tile);
 			float4 fog = TraceFog(rHit, hit, rRay);
 			reflectionColor.xyz += fog.xyz * fog.w * reflectionColor.w;
 			reflectionColor.w *= 1.0f - fog.w;
@@ -420,21 +746,95 @@ float3 TraceReflections(float3 normal, __global uchar * blocks, __read_only imag
 			break;
 		}
 	}
+	world->reflectSteps += world->steps - steps - (world->shadowSteps - shadowSteps);
 	return reflectionColor.xyz;
 }
 
-__kernel void trace(uint treeDepth, __global uchar * octree, __global uchar * blocks, __write_only image2d_t texture, int width, int height, float16 camera, __read_only image2d_t terrain, int isUnderWater, float time)
+bool BeamBoxEmpty(World * world, int3 boxMin, int3 boxMax)
+{
+	if (any(boxMin < 0) || boxMax.x >= world->levelSize || boxMax.y >= LEVEL_HEIGHT || boxMax.z >= world->levelSize) { return false; }
+	for (int z = boxMin.z; z <= boxMax.z; z++)
+	{
+		for (int x = boxMin.x; x <= boxMax.x; x++)
+		{
+			int height = world->heights[z * world->levelSize + x];
+			for (int y = boxMin.y; y <= min(boxMax.y, height - 1); y++)
+			{
+				if (GetBlock(world, (int3){ x, y, z }) != BlockTypeNone) { return false; }
+			}
+		}
+	}
+	return true;
+}
+
+float BeamStartDistance(World * world, float3 origin, float3 ray, float spread)
+{
+	float t = 0.0f;
+	for (int i = 0; i < 512; i++)
+	{
+		float3 p = origin + ray * t;
+		int3 voxel = convert_int3(floor(p));
+		int3 nodeMin;
+		int size = PointInBounds(voxel, world->levelSize) ? OctreeEmptyNode(world, voxel, &nodeMin) : 0;
+		if (size > 1)
+		{
+			float radius = spread * (t + size * 1.7320508f) + Epsilon;
+			float3 boxMin = convert_float3(nodeMin) + radius, boxMax = convert_float3(nodeMin + size) - radius;
+			if (all(p >= boxMin) && all(p <= boxMax))
+			{
+				float3 exits = select((float3)(INFINITY), (select(boxMin, boxMax, ray > 0.0f) - origin) / ray, ray != 0.0f);
+				float exit = min(min(exits.x, exits.y), exits.z);
+				if (exit > t + 1.0f)
+				{
+					t = exit;
+					continue;
+				}
+			}
+		}
+		float3 q = origin + ray * (t + 1.0f);
+		float radius = spread * (t + 1.0f) + Epsilon;
+		if (!BeamBoxEmpty(world, convert_int3(floor(min(p, q) - radius)), convert_int3(floor(max(p, q) + radius)))) { break; }
+		t += 1.0f;
+	}
+	return t;
+}
+
+float TemporalStart(__global uint * hints, int x, int y, int width, int height)
+{
+	if (hints == NULL || x == 0 || y == 0 || x == width - 1 || y == height - 1) { return 0.0f; }
+	float guess = INFINITY, farthest = 0.0f;
+	for (int j = -1; j <= 1; j++)
+	{
+		for (int i = -1; i <= 1; i++)
+		{
+			float depth = as_float(hints[(y + j) * width + x + i]);
+			if (isinf(depth)) { return 0.0f; }
+			guess = min(guess, depth);
+			farthest = max(farthest, depth);
+		}
+	}
+	if (farthest - guess > TemporalAgreement) { return 0.0f; }
+	return max(guess - TemporalMargin, 0.0f);
+}
+
+bool SegmentIntersectsBox(float3 origin, float3 ray, float length, float3 boxMin, float3 boxMax)
+{
+	if (boxMin.x > boxMax.x) { return false; }
+	float3 t0 = (boxMin - origin) / ray, t1 = (boxMax - origin) / ray;
+	float3 tMin = fmin(t0, t1), tMax = fmax(t0, t1);
+	float enter = fmax(fmax(tMin.x, tMin.y), fmax(tMin.z, 0.0f));
+	float exit = fmin(fmin(tMax.x, tMax.y), fmin(tMax.z, length));
+	return enter <= exit;
+}
+
+float4 CameraRay(int x, int y, int width, int height, float16 camera, __read_only image2d_t terrain, bool isUnderWater, float time, float3 * origin, float3 * ray)
 {
-	int x = get_global_id(0);
-	int y = get_global_id(1);
-	if (x >= width || y >= height) { return; }
 	float2 uv = (float2){ 1.0f - 2.0f * (float)x / width, 2.0f * (float)y / height - 1.0f };
 	uv.x *= (float)width / height;
 	if (isUnderWater) { uv.y += sin(uv.x * (10.0 + sin(time)) + time) / (70.0f + 10.0f * sin(time)); };
 	
-	float fov = 70.0f;
-	float3 origin = MatrixTransformPoint(camera, (float3){ 0.0f, 0.0f, 0.0f });
-	float3 ray = normalize(MatrixTransformPoint(camera, (float3){ uv * 0.5f, 0.5f / tanpi(fov / 360.0f) }) - origin);
+	*origin = MatrixTransformPoint(camera, (float3){ 0.0f, 0.0f, 0.0f });
+	*ray = normalize(MatrixTransformPoint(camera, (float3){ uv * 0.5f, CameraFocalLength }) - *origin);
 	float4 fragColor = { 0.0f, 0.0f, 0.0f, 1.0f };
 	
 	if (isUnderWater)
@@ -444,19 +844,65 @@ __kernel void trace(uint treeDepth, __global uchar * octree, __global uchar * bl
 		fragColor.xyz += water.xyz * water.w * fragColor.w;;
 		fragColor.w *= 1.0f - water.w;
 	}
-	
-	float3 lightDir = normalize((float3){ 1.0f, 1.0f, 0.5f });
-	int levelSize = 1;
-	for (uint i = 0; i < treeDepth; i++) { levelSize *= 2; }
+	return fragColor;
+}
+
+void WorldStatistics(World * world, __global uint * stats)
+{
+	if (stats == NULL) { return; }
+	atomic_add(&stats[0], world->steps);
+	atomic_add(&stats[1], world->rays);
+	atomic_add(&stats[2], world->layers);
+	atomic_add(&stats[3], world->shadowSteps);
+	atomic_add(&stats[4], world->reflectSteps);
+}
+
+void TracePixel(int x, int y, uint treeDepth, __global uchar * octree, __global uchar * blocks, __write_only image2d_t texture, int width, int height, float16 camera, __read_only image2d_t terrain, int isUnderWater, float time, __global uint * stats, __global uchar * heights, __global uchar * distances, int traversalMode, __global uint * bricks, __global uchar * brickPool, int storage, __global float * starts, __global uint * hints, __global float * depths, float4 dirtyMin, float4 dirtyMax, int checkerboard, __global uchar4 * sun, __global float * clouds, __global uint4 * counters, __constant BlockMaterial * materials)
+{
+	if (x >= width || y >= height) { return; }
+	if (checkerboard >= 0 && ((x + y) & 1) != checkerboard)
+	{
+		if (depths != NULL) { depths[y * width + x] = INFINITY; }
+		return;
+	}
+	float3 origin, ray;
+	bool underWater = UnderWater(isUnderWater);
+	float4 fragColor = CameraRay(x, y, width, height, camera, terrain, underWater, time, &origin, &ray);
+	float start = starts != NULL ? starts[(y / BeamTileSize) * ((width + BeamTileSize - 1) / BeamTileSize) + x / BeamTileSize] : 0.0f;
+	float3 lightDir = LightDirection;
+	World world = { .treeDepth = treeDepth, .levelSize = 1 << treeDepth, .octree = octree, .blocks = blocks, .bricks = bricks, .brickPool = brickPool, .storage = storage, .heights = heights, .distances = distances, .traversalMode = traversalMode, .sun = sun, .clouds = clouds, .materials = materials, .steps = 0, .rays = 1, .layers = 0, .shadowSteps = 0, .reflectSteps = 0 };
+	float guess = TemporalStart(hints, x, y, width, height);
+	bool guessed = guess > start && !SegmentIntersectsBox(origin, ray, guess, dirtyMin.xyz, dirtyMax.xyz);
+	bool first = depths != NULL;
 	float4 hitColor = { 0.0f, 0.0f, 0.0f, 0.0f };
-	float3 exit = origin, hit, normal;
+	float3 exit = origin + ray * (guessed ? guess : start), hit, normal;
 	int3 voxel;
 	uchar tile = 0;
-	bool inWater = isUnderWater;
+	bool inWater = underWater;
 	float3 waterEntry = origin;
+	Traversal t;
+	TraversalBegin(&t, ray, exit);
 	while (hitColor.w < 1.0f)
 	{
-		if (RaySceneIntersection(blocks, terrain, ray, exit, levelSize, inWater, time, &voxel, &hit, &exit, &tile, &normal, &hitColor))
+		world.layers++;
+		bool found = RaySceneIntersection(&world, terrain, &t, inWater, time, &voxel, &hit, &exit, &tile, &normal, &hitColor);
+		if (guessed)
+		{
+			guessed = false;
+			if (!found || tile == BlockTypeCloud || distance(hit, origin) > guess + 4.0f * TemporalMargin)
+			{
+				exit = origin + ray * start;
+				TraversalBegin(&t, ray, exit);
+				hitColor = (float4){ 0.0f, 0.0f, 0.0f, 0.0f };
+				continue;
+			}
+		}
+		if (first)
+		{
+			depths[y * width + x] = found && tile != BlockTypeCloud ? distance(hit, origin) : INFINITY;
+			first = false;
+		}
+		if (found)
 		{
 			if (inWater)
 			{
@@ -464,14 +910,14 @@ __kernel void trace(uint treeDepth, __global uchar * octree, __global uchar * bl
 				else { fragColor.w *= (1.0f - min(distance(hit, waterEntry) / 10.0f, 1.0f)); }
 			}
 			hitColor.xyz = TraceLighting(hitColor.xyz, lightDir, normal, ray, tile);
-			hitColor.xyz = TraceShadows(hitColor.xyz, lightDir, blocks, terrain, hit, levelSize, inWater, waterEntry, time, tile);
+			hitColor.xyz = TraceShadows(hitColor.xyz, lightDir, &world, terrain, hit, normal, inWater, waterEntry, time, tile);
 			float4 fog = TraceFog(hit, origin, ray);
 			fragColor.xyz += fog.xyz * fog.w * fragColor.w;
 			fragColor.w *= 1.0f - fog.w;
-			float reflectiveness = GetTileReflectiveness(tile, hitColor);
+			float reflectiveness = GetTileReflectiveness(materials, tile, hitColor);
 			if (reflectiveness > 0.0f)
 			{
-				float3 rColor = TraceReflections(normal, blocks, terrain, hit, levelSize, ray, lightDir, time);
+				float3 rColor = TraceReflections(normal, &world, terrain, hit, ray, lightDir, time);
 				fragColor.xyz += rColor * reflectiveness * fragColor.w;
 				fragColor.w *= 1.0f - reflectiveness;
 			}
@@ -486,6 +932,7 @@ __kernel void trace(uint treeDepth, __global uchar * octree, __global uchar * bl
 				{
 					ray = normalize(ray - 2.0f * dot(ray, normal) * normal) * (float3){ 1.0f, -1.0f, 1.0f };
 					exit = hit + distance(hit, exit) * ray;
+					TraversalBegin(&t, ray, exit);
 				}
 			}
 		}
@@ -496,5 +943,374 @@ __kernel void trace(uint treeDepth, __global uchar * octree, __global uchar * bl
 			break;
 		}
 	}
-	write_imagef(texture, (int2){ x, y }, (float4){ fragColor.xyz, 1.0f });
+	write_imagef(texture, (int2){ x, y - (int)get_global_offset(1) }, (float4){ fragColor.xyz, 1.0f });
+	
+	if (counters != NULL) { counters[y * width + x] = (uint4){ world.steps - world.shadowSteps - world.reflectSteps, world.layers, world.shadowSteps, world.reflectSteps }; }
+	WorldStatistics(&world, stats);
+}
+
+__kernel void trace(uint treeDepth, __global uchar * octree, __global uchar * blocks, __write_only image2d_t texture, int width, int height, float16 camera, __read_only image2d_t terrain, int isUnderWater, float time, __global uint * stats, __global uchar * heights, __global uchar * distances, int traversalMode, __global uint * bricks, __global uchar * brickPool, int storage, __global float * starts, __global uint * hints, __global float * depths, float4 dirtyMin, float4 dirtyMax, int checkerboard, __global uchar4 * sun, __global float * clouds, __global uint4 * counters, __constant BlockMaterial * materials)
+{
+	TracePixel(get_global_id(0), get_global_id(1), treeDepth, octree, blocks, texture, width, height, camera, terrain, isUnderWater, time, stats, heights, distances, traversalMode, bricks, brickPool, storage, starts, hints, depths, dirtyMin, dirtyMax, checkerboard, sun, clouds, counters, materials);
+}
+
+__kernel void tracePersistent(uint treeDepth, __global uchar * octree, __global uchar * blocks, __write_only image2d_t texture, int width, int height, float16 camera, __read_only image2d_t terrain, int isUnderWater, float time, __global uint * stats, __global uchar * heights, __global uchar * distances, int traversalMode, __global uint * bricks, __global uchar * brickPool, int storage, __global float * starts, __global uint * hints, __global float * depths, float4 dirtyMin, float4 dirtyMax, int checkerboard, __global uchar4 * sun, __global float * clouds, __global uint4 * counters, __constant BlockMaterial * materials, __global uint * tileCounter)
+{
+	__local uint nextTile;
+	int tilesX = (width + PersistentTileSize - 1) / PersistentTileSize;
+	uint tileCount = tilesX * ((height + PersistentTileSize - 1) / PersistentTileSize);
+	while (true)
+	{
+		if (get_local_id(0) == 0) { nextTile = atomic_inc(tileCounter); }
+		barrier(CLK_LOCAL_MEM_FENCE);
+		uint tile = nextTile;
+		barrier(CLK_LOCAL_MEM_FENCE);
+		if (tile >= tileCount) { return; }
+		int2 base = (int2){ tile % tilesX, tile / tilesX } * PersistentTileSize;
+		for (int i = get_local_id(0); i < PersistentTileSize * PersistentTileSize; i += get_local_size(0))
+		{
+			TracePixel(base.x + i % PersistentTileSize, base.y + i / PersistentTileSize, treeDepth, octree, blocks, texture, width, height, camera, terrain, isUnderWater, time, stats, heights, distances, traversalMode, bricks, brickPool, storage, starts, hints, depths, dirtyMin, dirtyMax, checkerboard, sun, clouds, counters, materials);
+		}
+	}
+}
+
+float3 PixelRay(float16 camera, int2 pixel, int width, int height)
+{
+	float2 uv = (float2){ (1.0f - 2.0f * (float)pixel.x / width) * width / height, 2.0f * (float)pixel.y / height - 1.0f };
+	float3 origin = MatrixTransformPoint(camera, (float3){ 0.0f, 0.0f, 0.0f });
+	return normalize(MatrixTransformPoint(camera, (float3){ uv * 0.5f, CameraFocalLength }) - origin);
+}
+
+bool ProjectToScreen(float16 camera, float3 point, int width, int height, float2 * pixel)
+{
+	float3 p = point - MatrixTransformPoint(camera, (float3){ 0.0f, 0.0f, 0.0f });
+	float3 local = (float3){ dot(p, camera.s012), dot(p, camera.s456), dot(p, camera.s89A) };
+	if (local.z <= Epsilon) { return false; }
+	float2 uv = 2.0f * CameraFocalLength * local.xy / local.z;
+	*pixel = (float2){ (1.0f - uv.x * height / width) * width * 0.5f, (uv.y + 1.0f) * height * 0.5f };
+	return pixel->x > -0.5f && pixel->y > -0.5f && pixel->x < width - 0.5f && pixel->y < height - 0.5f;
+}
+
+__kernel void reproject(__global float * depths, __global uint * hints, int width, int height, float16 previous, float16 camera, int splat)
+{
+	int x = get_global_id(0);
+	int y = get_global_id(1);
+	if (x >= width || y >= height) { return; }
+	float depth = depths[y * width + x];
+	if (isinf(depth)) { return; }
+	float3 point = MatrixTransformPoint(previous, (float3){ 0.0f, 0.0f, 0.0f }) + PixelRay(previous, (int2){ x, y }, width, height) * depth;
+	float2 projected;
+	if (!ProjectToScreen(camera, point, width, height, &projected)) { return; }
+	int2 pixel = convert_int2_rtn(projected + 0.5f);
+	uint depthBits = as_uint(distance(point, MatrixTransformPoint(camera, (float3){ 0.0f, 0.0f, 0.0f })));
+	for (int j = -splat; j <= splat; j++)
+	{
+		for (int i = -splat; i <= splat; i++)
+		{
+			int2 q = pixel + (int2){ i, j };
+			if (all(q >= 0) && q.x < width && q.y < height) { atomic_min(&hints[q.y * width + q.x], depthBits); }
+		}
+	}
+}
+
+int2 CheckerboardNeighbour(int2 pixel, int2 offset, int width, int height)
+{
+	int2 q = pixel + offset;
+	return any(q < 0) || q.x >= width || q.y >= height ? pixel - offset : q;
+}
+
+__kernel void reconstruct(__read_only image2d_t source, __read_only image2d_t history, __write_only image2d_t output, __global float * depths, int width, int height, float16 camera, float16 previous, int parity, int hasHistory)
+{
+	int x = get_global_id(0);
+	int y = get_global_id(1);
+	if (x >= width || y >= height) { return; }
+	int2 pixel = (int2){ x, y };
+	if (((x + y) & 1) == parity)
+	{
+		write_imagef(output, pixel, read_imagef(source, PixelSampler, pixel));
+		return;
+	}
+	
+	int2 offsets[4] = { { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 } };
+	float4 neighbours[4];
+	float4 low = (float4)(INFINITY), high = (float4)(-INFINITY);
+	float depth = INFINITY;
+	for (int i = 0; i < 4; i++)
+	{
+		int2 q = CheckerboardNeighbour(pixel, offsets[i], width, height);
+		neighbours[i] = read_imagef(source, PixelSampler, q);
+		low = min(low, neighbours[i]);
+		high = max(high, neighbours[i]);
+		depth = min(depth, depths[q.y * width + q.x]);
+	}
+	float4 horizontal = neighbours[0] - neighbours[1], vertical = neighbours[2] - neighbours[3];
+	float4 spatial = dot(horizontal, horizontal) < dot(vertical, vertical) ? (neighbours[0] + neighbours[1]) * 0.5f : (neighbours[2] + neighbours[3]) * 0.5f;
+	
+	float2 projected;
+	float3 point = MatrixTransformPoint(camera, (float3){ 0.0f, 0.0f, 0.0f }) + PixelRay(camera, pixel, width, height) * min(depth, 4096.0f);
+	if (!hasHistory || !ProjectToScreen(previous, point, width, height, &projected))
+	{
+		write_imagef(output, pixel, spatial);
+		return;
+	}
+	float4 past = read_imagef(history, PixelSampler, convert_int2_rtn(projected + 0.5f));
+	if (distance(projected, convert_float2(pixel)) > 0.01f) { past = clamp(past, low, high); }
+	write_imagef(output, pixel, past);
+}
+
+__kernel void beam(WorldParameters, __global float * starts, int width, int height, float16 camera, int isUnderWater)
+{
+	int tx = get_global_id(0);
+	int ty = get_global_id(1);
+	int tilesX = (width + BeamTileSize - 1) / BeamTileSize, tilesY = (height + BeamTileSize - 1) / BeamTileSize;
+	if (tx >= tilesX || ty >= tilesY) { return; }
+	if (isUnderWater)
+	{
+		starts[ty * tilesX + tx] = 0.0f;
+		return;
+	}
+	
+	int2 tileMin = (int2){ tx, ty } * BeamTileSize;
+	int2 tileMax = min(tileMin + BeamTileSize - 1, (int2){ width - 1, height - 1 });
+	float3 origin, corners[4];
+	CameraRay(tileMin.x, tileMin.y, width, height, camera, terrain, false, time, &origin, &corners[0]);
+	CameraRay(tileMax.x, tileMin.y, width, height, camera, terrain, false, time, &origin, &corners[1]);
+	CameraRay(tileMin.x, tileMax.y, width, height, camera, terrain, false, time, &origin, &corners[2]);
+	CameraRay(tileMax.x, tileMax.y, width, height, camera, terrain, false, time, &origin, &corners[3]);
+	float3 ray = normalize(corners[0] + corners[1] + corners[2] + corners[3]);
+	float cosine = 1.0f;
+	for (int i = 0; i < 4; i++) { cosine = min(cosine, dot(ray, corners[i])); }
+	float spread = sqrt(1.0f - cosine * cosine) / cosine;
+	
+	World world = WorldArguments;
+	starts[ty * tilesX + tx] = BeamStartDistance(&world, origin, ray, spread);
+}
+
+void PathStoreTraversal(__global Path * path, Traversal * t)
+{
+	path->traversal = (float4){ t->origin, t->enter };
+	path->voxel = (int4){ t->voxel, t->axis };
+}
+
+__kernel void generatePaths(WorldParameters, __global Path * paths, __global uint * queue, int width, int height, float16 camera, int isUnderWater, __global float * starts)
+{
+	int x = get_global_id(0);
+	int y = get_global_id(1);
+	if (x >= width || y >= height) { return; }
+	int index = y * width + x;
+	float3 origin, ray;
+	float4 color = CameraRay(x, y, width, height, camera, terrain, isUnderWater, time, &origin, &ray);
+	float start = starts != NULL ? starts[(y / BeamTileSize) * ((width + BeamTileSize - 1) / BeamTileSize) + x / BeamTileSize] : 0.0f;
+	paths[index].origin = (float4){ origin, 0.0f };
+	paths[index].ray = (float4){ ray, 0.0f };
+	paths[index].exit = (float4){ origin + ray * start, 0.0f };
+	paths[index].water = (float4){ origin, isUnderWater ? 1.0f : 0.0f };
+	paths[index].color = color;
+	Traversal t;
+	TraversalBegin(&t, ray, origin + ray * start);
+	PathStoreTraversal(&paths[index], &t);
+	queue[index] = index;
+	if (stats != NULL) { atomic_inc(&stats[1]); }
+}
+
+__kernel void extendPaths(WorldParameters, __global Path * paths, __global uint * queue, uint bounce, __global uint * next, __global uint * shadeQueue, __global uint * counters)
+{
+	if (get_global_id(0) >= counters[4 * bounce]) { return; }
+	counters += 4 * (bounce + 1);
+	World world = WorldArguments;
+	uint index = queue[get_global_id(0)];
+	Path path = paths[index];
+	bool inWater = path.water.w != 0.0f;
+	float3 ray = path.ray.xyz, exit = path.exit.xyz, hit, normal;
+	float4 hitColor = { 0.0f, 0.0f, 0.0f, 0.0f };
+	int3 voxel;
+	uchar tile = 0;
+	Traversal t;
+	TraversalResume(&t, ray, path.traversal, path.voxel);
+	if (RaySceneIntersection(&world, terrain, &t, inWater, time, &voxel, &hit, &exit, &tile, &normal, &hitColor))
+	{
+		PathStoreTraversal(&paths[index], &t);
+		paths[index].exit.xyz = exit;
+		paths[index].hit = (float4){ hit, (float)tile };
+		paths[index].normal.xyz = normal;
+		paths[index].shade = hitColor;
+		if (inWater && (tile == BlockTypeWater || tile == BlockTypeStillWater)) { next[atomic_inc(&counters[0])] = index; }
+		else { shadeQueue[atomic_inc(&counters[1])] = index; }
+	}
+	else
+	{
+		if (inWater) { path.color.w *= (1.0f - min(distance(hit, path.water.xyz) / 10.0f, 1.0f)); }
+		path.color.xyz += BGColor(ray) * path.color.w;
+		paths[index].color = path.color;
+	}
+	WorldStatistics(&world, stats);
+}
+
+__kernel void shadePaths(WorldParameters, __global Path * paths, __global uint * queue, __global uint * counters, __global uint * next, __global uint * shadowQueue, __global uint * reflectQueue, uint bounce)
+{
+	counters += 4 * (bounce + 1);
+	if (get_global_id(0) >= counters[1]) { return; }
+	uint index = queue[get_global_id(0)];
+	Path path = paths[index];
+	float3 ray = path.ray.xyz, hit = path.hit.xyz, normal = path.normal.xyz;
+	uchar tile = (uchar)path.hit.w;
+	float4 hitColor = path.shade;
+	float4 fragColor = path.color;
+	bool inWater = path.water.w != 0.0f;
+	if (inWater) { fragColor.w *= (1.0f - min(distance(hit, path.water.xyz) / 10.0f, 1.0f)); }
+	
+	paths[index].incident = path.ray;
+	paths[index].entry = path.water;
+	float4 fog = TraceFog(hit, path.origin.xyz, ray);
+	fragColor.xyz += fog.xyz * fog.w * fragColor.w;
+	fragColor.w *= 1.0f - fog.w;
+	float reflectiveness = GetTileReflectiveness(materials, tile, hitColor);
+	if (reflectiveness > 0.0f)
+	{
+		paths[index].normal.w = reflectiveness * fragColor.w;
+		reflectQueue[atomic_inc(&counters[3])] = index;
+		fragColor.w *= 1.0f - reflectiveness;
+	}
+	paths[index].shade = (float4){ TraceLighting(hitColor.xyz, LightDirection, normal, ray, tile), hitColor.w * fragColor.w };
+	shadowQueue[atomic_inc(&counters[2])] = index;
+	fragColor.w *= 1.0f - hitColor.w;
+	
+	if (!inWater && (tile == BlockTypeWater || tile == BlockTypeStillWater))
+	{
+		paths[index].water = (float4){ hit, 1.0f };
+		if (normal.y > 0.0f)
+		{
+			ray = normalize(ray - 2.0f * dot(ray, normal) * normal) * (float3){ 1.0f, -1.0f, 1.0f };
+			paths[index].ray.xyz = ray;
+			paths[index].exit.xyz = hit + distance(hit, path.exit.xyz) * ray;
+			Traversal t;
+			TraversalBegin(&t, ray, hit + distance(hit, path.exit.xyz) * ray);
+			PathStoreTraversal(&paths[index], &t);
+		}
+	}
+	paths[index].color = fragColor;
+	if (hitColor.w < 1.0f) { next[atomic_inc(&counters[0])] = index; }
+}
+
+__kernel void shadowPaths(WorldParameters, __global Path * paths, __global uint * queue, __global uint * counters, uint bounce)
+{
+	if (get_global_id(0) >= counters[4 * (bounce + 1) + 2]) { return; }
+	World world = WorldArguments;
+	uint index = queue[get_global_id(0)];
+	Path path = paths[index];
+	float3 color = TraceShadows(path.shade.xyz, LightDirection, &world, terrain, path.hit.xyz, path.normal.xyz, path.entry.w != 0.0f, path.entry.xyz, time, (uchar)path.hit.w);
+	paths[index].color.xyz += color * path.shade.w;
+	WorldStatistics(&world, stats);
+}
+
+__kernel void reflectPaths(WorldParameters, __global Path * paths, __global uint * queue, __global uint * counters, uint bounce)
+{
+	if (get_global_id(0) >= counters[4 * (bounce + 1) + 3]) { return; }
+	World world = WorldArguments;
+	uint index = queue[get_global_id(0)];
+	Path path = paths[index];
+	float3 color = TraceReflections(path.normal.xyz, &world, terrain, path.hit.xyz, path.incident.xyz, LightDirection, time);
+	paths[index].color.xyz += color * path.normal.w;
+	WorldStatistics(&world, stats);
+}
+
+__kernel void resolvePaths(__global Path * paths, __write_only image2d_t texture, int width, int height)
+{
+	int x = get_global_id(0);
+	int y = get_global_id(1);
+	if (x >= width || y >= height) { return; }
+	write_imagef(texture, (int2){ x, y }, (float4){ paths[y * width + x].color.xyz, 1.0f });
+}
+
+__kernel void upscale(__read_only image2d_t source, __write_only image2d_t texture, int width, int height)
+{
+	int x = get_global_id(0);
+	int y = get_global_id(1);
+	if (x >= width || y >= height) { return; }
+	float2 p = ((float2){ x, y } + 0.5f) * convert_float2(get_image_dim(source)) / (float2){ width, height } - 0.5f;
+	float2 base = floor(p), f = p - base;
+	int2 b = convert_int2(base);
+	float4 nearest = read_imagef(source, PixelSampler, convert_int2(base + round(f)));
+	float4 samples[4] =
+	{
+		read_imagef(source, PixelSampler, b),
+		read_imagef(source, PixelSampler, b + (int2){ 1, 0 }),
+		read_imagef(source, PixelSampler, b + (int2){ 0, 1 }),
+		read_imagef(source, PixelSampler, b + (int2){ 1, 1 }),
+	};
+	float weights[4] = { (1.0f - f.x) * (1.0f - f.y), f.x * (1.0f - f.y), (1.0f - f.x) * f.y, f.x * f.y };
+	float4 color = { 0.0f, 0.0f, 0.0f, 0.0f };
+	float total = 0.0f;
+	for (int i = 0; i < 4; i++)
+	{
+		float3 d = samples[i].xyz - nearest.xyz;
+		float w = weights[i] * exp(-dot(d, d) * UpscaleEdgeSharpness) + 0.0001f;
+		color += samples[i] * w;
+		total += w;
+	}
+	write_imagef(texture, (int2){ x, y }, (float4){ color.xyz / total, 1.0f });
+}
+
+__kernel void heatmap(__global uint4 * counters, __write_only image2d_t image, int width, int height, int channel, float scale)
+{
+	int x = get_global_id(0);
+	int y = get_global_id(1);
+	if (x >= width || y >= height) { return; }
+	uint4 count = counters[y * width + x];
+	uint values[4] = { count.x, count.y, count.z, count.w };
+	float t = clamp(values[channel] / scale, 0.0f, 1.0f);
+	float3 color = clamp((float3){ 4.0f * t - 2.0f, 2.0f - fabs(4.0f * t - 2.0f), 2.0f - 4.0f * t }, 0.0f, 1.0f);
+	write_imagef(image, (int2){ x, y }, (float4){ color, 1.0f });
+}
+
+__kernel void distanceField(uint treeDepth, __global uchar * blocks, __global uint * bricks, __global uchar * brickPool, int storage, __global uchar * src, int4 srcMin, int4 srcSize, __global uchar * dst, int4 dstMin, int4 dstSize, int axis)
+{
+	World world = { .treeDepth = treeDepth, .levelSize = 1 << treeDepth, .blocks = blocks, .bricks = bricks, .brickPool = brickPool, .storage = storage };
+	int3 p = (int3){ get_global_id(0), get_global_id(1), get_global_id(2) };
+	if (!PointInBounds(p, world.levelSize)) { return; }
+	int3 dir = (int3){ axis == 0, axis == 1, axis == 2 };
+	int best = DistanceFieldMax;
+	for (int i = -DistanceFieldMax; i <= DistanceFieldMax && best > 0; i++)
+	{
+		int3 q = p + dir * i;
+		if (!PointInBounds(q, world.levelSize)) { continue; }
+		int d;
+		if (axis == 0) { d = GetBlock(&world, q) == BlockTypeNone ? DistanceFieldMax : 0; }
+		else
+		{
+			int3 s = q - srcMin.xyz;
+			d = src[(s.y * srcSize.z + s.z) * srcSize.x + s.x];
+		}
+		best = min(best, max(abs(i), d));
+	}
+	int3 o = p - dstMin.xyz;
+	dst[(o.y * dstSize.z + o.z) * dstSize.x + o.x] = best;
+}
+
+__kernel void sunVisibility(WorldParameters)
+{
+	World world = WorldArguments;
+	int3 p = (int3){ get_global_id(0), get_global_id(1), get_global_id(2) };
+	if (!PointInBounds(p, world.levelSize)) { return; }
+	float3 lightDir = LightDirection;
+	float3 center = convert_float3(p) + 0.5f;
+	uchar tile = GetBlock(&world, p);
+	bool inWater = tile == BlockTypeWater || tile == BlockTypeStillWater;
+	for (int i = 0; i < SunEntries; i++)
+	{
+		float3 face = center - 0.5f * sign(lightDir) * convert_float3((int3){ i == 0, i == 1, i == 2 });
+		float3 exit = i == SunEntryCenter ? center + lightDir * (0.5f / max(fabs(lightDir.x), max(fabs(lightDir.y), fabs(lightDir.z))) + Epsilon) : face + lightDir * Epsilon;
+		float4 shadowColor = ShadowTransmittance(&world, terrain, lightDir, exit, inWater, face, time, false);
+		sun[SunIndex(&world, p) * SunEntries + i] = convert_uchar4_sat_rte(shadowColor * 255.0f);
+	}
+}
+
+__kernel void cloudLayer(__global float * clouds, float2 origin, float time)
+{
+	int x = get_global_id(0);
+	int y = get_global_id(1);
+	if (x == 0 && y == 0) { vstore4((float4){ origin, time, 0.0f }, 0, clouds); }
+	if (x >= CloudLayerSize || y >= CloudLayerSize) { return; }
+	float3 p = (float3){ origin.x + (x + 0.5f) * CloudTexelSize, CloudHeight, origin.y + (y + 0.5f) * CloudTexelSize };
+	clouds[4 + y * CloudLayerSize + x] = CloudSDF(p, time);
 }